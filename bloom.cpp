@@ -1,19 +1,104 @@
 #include "bloom.h"
 
+#include <algorithm>
+#include <cmath>
+
+void bloom::hash(uint64_t key, BloomHashKind kind, uint32_t hashV[4]) {
+    if (kind == BloomHashKind::Murmur3) {
+        MurmurHash3_x64_128(&key, sizeof(key), 1, hashV);
+        return;
+    }
+    // 双重哈希：一个64位混合值的高低两半生成4个探测位置
+    uint64_t h  = mix64(key);
+    uint32_t h1 = (uint32_t)h, h2 = (uint32_t)(h >> 32);
+    for (int i = 0; i < 4; ++i)
+        hashV[i] = h1 + i * h2;
+}
+
+const uint32_t *bloomProbe::hash(BloomHashKind kind) {
+    int k = (int)kind;
+    if (!computed[k]) {
+        bloom::hash(key, kind, hashV[k]);
+        computed[k] = true;
+    }
+    return hashV[k];
+}
+
 void bloom::insert(uint64_t key) {
-    MurmurHash3_x64_128(&key, sizeof(key), 1, hashV);
+    uint32_t hashV[4];
+    hash(key, kind, hashV);
     for (int i = 0; i < 4; ++i) {
         uint32_t p = (hashV[i] % (8 * M));
-        s[p]       = true;
+        setBit(p);
+    }
+}
+
+void bloom::fold(uint32_t size) {
+    if (size >= s.size())
+        return;
+    for (size_t i = size; size && i < s.size(); ++i)
+        s[i % size] |= s[i];
+    s.resize(size);
+    s.shrink_to_fit();
+}
+
+uint32_t bloom::sizeFor(double bitsPerKey, uint64_t cnt, bool atMost) {
+    if (bitsPerKey < 0)
+        return M;
+    double need = bitsPerKey * cnt / 8;
+    if (need < 1)
+        return 0;
+    // M = 2^11 * 5，约数不多，直接枚举
+    uint32_t best = atMost ? 0 : M;
+    for (uint32_t d = 1; d <= M; ++d) {
+        if (M % d)
+            continue;
+        if (atMost ? d <= need : std::abs(std::log(d / need)) < std::abs(std::log(best / need)))
+            best = d;
     }
+    return best;
+}
+
+bool bloom::search(uint64_t key) const {
+    bloomProbe probe(key);
+    return search(probe);
 }
 
-bool bloom::search(uint64_t key) {
-    MurmurHash3_x64_128(&key, sizeof(key), 1, hashV);
+bool bloom::search(bloomProbe &probe) const {
+    if (s.empty())
+        return true;
+    const uint32_t *hashV = probe.hash(kind);
+    uint32_t bits         = s.size() * 8;
     for (int i = 0; i < 4; ++i) {
-        uint32_t p = (hashV[i] % (8 * M));
-        if (!s[p])
+        uint32_t p = (hashV[i] % (8 * M)) % bits;
+        if (!getBit(p))
             return false;
     }
     return true;
 }
+
+std::vector<double> allocateBloomBits(const std::vector<uint64_t> &entries, const std::vector<double> &maxBits,
+                                      double budgetBits) {
+    const double ln2sq = std::log(2) * std::log(2);
+    // 第i层假阳性率取 min(1, lambda * n_i)，对应每键位数 -ln(p) / ln2^2，总位数随lambda单调递减
+    auto allocate = [&](double lambda, std::vector<double> &bits) {
+        double total = 0;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            double p = std::min(1.0, lambda * entries[i]);
+            bits[i]  = entries[i] ? std::min(maxBits[i], -std::log(p) / ln2sq) : 0;
+            total += bits[i] * entries[i];
+        }
+        return total;
+    };
+    std::vector<double> bits(entries.size(), 0);
+    double lo = 1e-30, hi = 1;
+    for (int iter = 0; iter < 100; ++iter) {
+        double mid = std::sqrt(lo * hi); // lambda跨越多个数量级，按几何平均二分
+        if (allocate(mid, bits) > budgetBits)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    allocate(hi, bits);
+    return bits;
+}
@@ -1,46 +1,118 @@
 #ifndef LSM_KV_BLOOM_H
 #define LSM_KV_BLOOM_H
 #include "MurmurHash3.h"
+#include "options.h"
 
-#include <bitset>
 #include <cstdint>
+#include <cstring>
+#include <vector>
 
 const uint32_t M = 10240;
 
+// splitmix64的终结混合，对整数键只需几次乘法和移位；bloom的Mix64和全局哈希索引共用
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * @brief 一次查找中各表的bloom共用的哈希值：每种哈希函数对key至多计算一次
+ *
+ * 只在一个线程内使用，不同线程各自构造
+ */
+class bloomProbe {
+private:
+    uint64_t key;
+    uint32_t hashV[2][4];
+    bool computed[2] = {false, false};
+
+public:
+    explicit bloomProbe(uint64_t key) : key(key) {}
+
+    uint64_t getKey() const {
+        return key;
+    }
+
+    const uint32_t *hash(BloomHashKind kind);
+};
+
+/**
+ * @brief 文件中的过滤器固定为8 * M位，探测位置为 哈希值 % (8 * M)。
+ *
+ * 内存中可以把它折叠成8 * size位（size整除M）：第p位并入第p % (8 * size)位。
+ * 因为8 * size整除8 * M，折叠后按 哈希值 % (8 * size) 探测与原过滤器一致，只是假阳性率更高。
+ * size为0表示不要过滤器，任何键都可能存在
+ */
 class bloom {
 private:
-    std::bitset<8 * M> s;
-    uint32_t hashV[4];
+    // 与文件中的布局相同：第p位是s[p >> 3]的第(p & 7)位，读写文件时整块复制
+    std::vector<unsigned char> s;
+    BloomHashKind kind = BloomHashKind::Murmur3; // 表的哈希函数，记在文件头和清单中
 
 public:
-    bloom() {}
+    bloom() {
+        reset();
+    }
+
+    void reset() { // 恢复为M字节的空过滤器，不改哈希函数
+        s.assign(M, 0);
+    }
 
-    ~bloom() {
-        s.reset();
+    const unsigned char *data() const {
+        return s.data();
     }
 
-    void reset() {
-        s.reset();
+    void load(const unsigned char *buf) {
+        s.assign(buf, buf + M);
     }
 
-    void setBitset(std::bitset<8 * M> t) {
-        s = t;
+    uint32_t size() const { // 内存中的字节数
+        return s.size();
     }
 
-    std::bitset<8 * M> getBitset() {
-        return s;
+    void fold(uint32_t size); // 折叠成size字节，size须整除当前字节数（或为0）
+
+    // 每个键bitsPerKey位时应保留的字节数：取M的约数中与所需字节数比值最接近者（atMost时取不超过所需的最大者），
+    // bitsPerKey < 0表示完整的M字节
+    static uint32_t sizeFor(double bitsPerKey, uint64_t cnt, bool atMost = false);
+
+    BloomHashKind getKind() const {
+        return kind;
     }
 
-    bool getBit(uint32_t p) {
-        return s[p];
+    void setKind(BloomHashKind kind) {
+        this->kind = kind;
+    }
+
+    bool getBit(uint32_t p) const {
+        return (s[p >> 3] >> (p & 7)) & 1;
     }
 
     void setBit(uint32_t p) {
-        s[p] = true;
+        s[p >> 3] |= 1 << (p & 7);
     }
 
-    void insert(uint64_t key);
-    bool search(uint64_t key);
+    static void hash(uint64_t key, BloomHashKind kind, uint32_t hashV[4]);
+
+    void insert(uint64_t key); // 只对未折叠的过滤器调用
+    bool search(uint64_t key) const;
+    bool search(bloomProbe &probe) const; // 不修改bloom本身，可以被多个线程同时调用
 };
 
+/**
+ * @brief Monkey式的过滤器内存分配：在总位数budgetBits内为各层选每键位数，使各层假阳性率之和最小
+ * @param entries 各层的条目数
+ * @param maxBits 各层每键位数的上限（文件中的过滤器折叠不出更多位），达到上限后余下的预算分给其它层
+ * @return 各层的每键位数，条目数为0的层为0
+ *
+ * 按最优哈希个数的近似 p = exp(-b * ln2^2)，最优解中各层假阳性率与条目数成正比：
+ * 大的层每键位数少，小的层多
+ */
+std::vector<double> allocateBloomBits(const std::vector<uint64_t> &entries, const std::vector<double> &maxBits,
+                                      double budgetBits);
+
 #endif // LSM_KV_BLOOM_H
@@ -0,0 +1,38 @@
+#pragma once
+
+#ifndef LSM_KV_COMPACTIONFILTER_H
+#define LSM_KV_COMPACTIONFILTER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+enum class FilterDecision {
+    Keep,       // 原样保留
+    Remove,     // 丢弃该键
+    ChangeValue // 用newValue替换原值
+};
+
+/**
+ * @brief 合并过滤器：合并归并时对每个键的最新版本调用一次，可以保留、丢弃或改写
+ *
+ * - 删除标记不会交给过滤器
+ * - Remove的键在输出层不是最底层时写成删除标记，以遮住更低层的旧版本；在最底层直接丢弃。
+ *   被丢弃的键之后在前台线程上从HNSW索引中删除，并在embedding.bin中追加删除标记：
+ *   再次写入该键时立即处理，其余的在下一次向量检索前或关闭时批量处理，不拖慢其他键的写入
+ * - ChangeValue只改写存储的值，键的嵌入向量保持不变；需要重新计算嵌入时应当调用put
+ * - 自动合并中平凡移动的表不经过归并，其中的条目不会被过滤；compactRange/compactAll会让范围内每个键都经过过滤器
+ *
+ * filter可能在多个子合并线程上并发调用，实现需要线程安全
+ */
+class CompactionFilter {
+public:
+    virtual ~CompactionFilter() = default;
+
+    virtual const char *name() const = 0;
+
+    // level为输出层；返回ChangeValue时把新值写入newValue
+    virtual FilterDecision filter(int level, uint64_t key, std::string_view value, std::string *newValue) = 0;
+};
+
+#endif // LSM_KV_COMPACTIONFILTER_H
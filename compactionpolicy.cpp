@@ -0,0 +1,310 @@
+#include "compactionpolicy.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+int overlapDepth(const std::vector<sstablehead> &tables) {
+    // 扫描线：同一个键上先计开始再计结束，键范围是闭区间
+    std::vector<std::pair<uint64_t, int>> events;
+    for (auto &table : tables) {
+        events.push_back({table.getMinV(), 0});
+        events.push_back({table.getMaxV(), 1});
+    }
+    std::sort(events.begin(), events.end());
+    int depth = 0, res = 0;
+    for (auto &[key, end] : events) {
+        depth += end ? -1 : 1;
+        res = std::max(res, depth);
+    }
+    return res;
+}
+
+std::vector<std::vector<int>> overlapGroups(const std::vector<sstablehead> &tables) {
+    std::vector<int> order(tables.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&](int a, int b) { return tables[a].getMinV() < tables[b].getMinV(); });
+    std::vector<std::vector<int>> groups;
+    uint64_t hi = 0;
+    for (int i : order) {
+        if (groups.empty() || tables[i].getMinV() > hi) {
+            groups.emplace_back();
+            hi = tables[i].getMaxV();
+        }
+        groups.back().push_back(i);
+        hi = std::max(hi, tables[i].getMaxV());
+    }
+    return groups;
+}
+
+std::vector<std::vector<int>> sortedRuns(const std::vector<sstablehead> &tables) {
+    std::vector<int> order(tables.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        if (tables[a].getTime() != tables[b].getTime())
+            return tables[a].getTime() < tables[b].getTime();
+        return tables[a].getMinV() < tables[b].getMinV();
+    });
+    std::vector<std::vector<int>> runs;
+    for (int i : order) {
+        bool fresh = runs.empty();
+        for (size_t k = 0; !fresh && k < runs.back().size(); ++k) {
+            const sstablehead &other = tables[runs.back()[k]];
+            fresh = !(tables[i].getMaxV() < other.getMinV() || tables[i].getMinV() > other.getMaxV());
+        }
+        if (fresh)
+            runs.emplace_back();
+        runs.back().push_back(i);
+    }
+    return runs;
+}
+
+uint64_t CompactionPolicy::pendingBytes(std::vector<sstablehead> *levels, int levelCount) {
+    // 分数超过1的层，按超出的比例计入该层字节数
+    uint64_t pending = 0;
+    for (int level = 0; level < levelCount; ++level) {
+        double s = score(levels, levelCount, level);
+        if (s < 1)
+            continue;
+        uint64_t bytes = 0;
+        for (sstablehead &it : levels[level])
+            bytes += it.getBytes();
+        pending += (level == 0) ? bytes : (uint64_t)(bytes * (1 - 1 / s));
+    }
+    return pending;
+}
+
+double CompactionPolicy::writeAmplification() const {
+    if (!flushBytes)
+        return 0;
+    return (double)(flushBytes + compactionWriteBytes) / flushBytes;
+}
+
+double LeveledCompactionPolicy::score(std::vector<sstablehead> *levels, int levelCount, int level) {
+    if (level + 1 >= levelCount)
+        return 0;
+    // 第0层按文件数触发，其余层按字节数
+    if (level == 0)
+        return (double)(partitionedLevel0 ? overlapDepth(levels[0]) : levels[0].size()) / level0Trigger;
+    uint64_t bytes = 0;
+    for (sstablehead &it : levels[level])
+        bytes += it.getBytes();
+    return (double)bytes / targetBytes(levels, levelCount, level);
+}
+
+uint64_t LeveledCompactionPolicy::targetBytes(std::vector<sstablehead> *levels, int levelCount, int level) const {
+    double target = levelBase;
+    for (int i = 1; i < level && target < 1e18; ++i)
+        target *= sizeRatio;
+    if (!dynamic)
+        return std::max<uint64_t>(target, 1);
+
+    // 找到最深的非空层，其以上各层按它的实际大小逐层除以扇出
+    int last = levelCount - 1;
+    while (last > 0 && levels[last].empty())
+        last--;
+    if (level >= last)
+        return std::max<uint64_t>(target, 1);
+    double bytes = 0;
+    for (sstablehead &it : levels[last])
+        bytes += it.getBytes();
+    for (int i = level; i < last; ++i)
+        bytes /= sizeRatio;
+    return std::max<uint64_t>(bytes, fileSize);
+}
+
+LeveledCompactionPolicy::LeveledCompactionPolicy(const KVStoreOptions &options, const std::string &cursorFile) :
+    mode(options.compactionPick), level0Trigger(std::max(1, options.level0CompactionTrigger)),
+    partitionedLevel0(options.level0Partitions > 1),
+    levelBase(std::max<uint64_t>(options.maxBytesForLevelBase, 1)), sizeRatio(std::max(1.01, options.levelSizeRatio)),
+    fileSize(options.targetFileSize), dynamic(options.dynamicLevelBytes), cursorFile(cursorFile) {
+    loadCursors();
+}
+
+void LeveledCompactionPolicy::loadCursors() {
+    if (cursorFile.empty())
+        return;
+    std::ifstream in(cursorFile, std::ios::binary);
+    uint64_t cursor;
+    while (in.read((char *)&cursor, sizeof(uint64_t)))
+        cursors.push_back(cursor);
+}
+
+void LeveledCompactionPolicy::saveCursors() {
+    if (cursorFile.empty())
+        return;
+    // 先写临时文件并落盘再改名，崩溃时读到的要么是旧游标，要么是完整的新游标。
+    // 游标只影响选表的顺序，写失败时保留旧文件，不中断合并
+    std::string tmp = cursorFile + ".tmp";
+    FILE *file      = fopen(tmp.c_str(), "wb");
+    if (!file) {
+        std::cout << "open " << tmp << " fail!" << std::endl;
+        return;
+    }
+    bool ok = fwrite(cursors.data(), sizeof(uint64_t), cursors.size(), file) == cursors.size() &&
+              utils::syncfile(file) == 0;
+    ok      = fclose(file) == 0 && ok;
+    if (!ok || std::rename(tmp.c_str(), cursorFile.c_str()) != 0) {
+        std::cout << "save " << cursorFile << " fail!" << std::endl;
+        utils::rmfile(tmp.c_str());
+    }
+}
+
+void LeveledCompactionPolicy::reset() {
+    cursors.clear();
+    if (!cursorFile.empty())
+        std::remove(cursorFile.c_str());
+}
+
+bool LeveledCompactionPolicy::pick(std::vector<sstablehead> *levels, int levelCount, int level, CompactionJob &job) {
+    job.level            = level;
+    job.outputLevel      = level + 1;
+    job.mergeOutputLevel = true;
+    job.inputs.clear();
+    // 第0层的表键范围互相重叠，需要全部参与
+    if (level == 0 && !partitionedLevel0) {
+        for (int i = 0; i < (int)levels[0].size(); i++)
+            job.inputs.push_back(i);
+        return !job.inputs.empty();
+    }
+    // 分区时只下推够深的重叠组；留在第0层的表与下推的组键范围不相交，不会遮住更新的版本
+    if (level == 0) {
+        std::vector<std::vector<int>> groups = overlapGroups(levels[0]);
+        for (auto &group : groups) {
+            std::vector<sstablehead> tables;
+            for (int i : group)
+                tables.push_back(levels[0][i]);
+            if (overlapDepth(tables) >= level0Trigger)
+                job.inputs.insert(job.inputs.end(), group.begin(), group.end());
+        }
+        if (job.inputs.empty()) { // 没有够深的组（例如手动调用），整层下推
+            for (int i = 0; i < (int)levels[0].size(); i++)
+                job.inputs.push_back(i);
+        }
+        return !job.inputs.empty();
+    }
+
+    // 其他层最多选择4个按键相邻的文件，先把本层的表按最小键排序
+    std::vector<sstablehead> &cur = levels[level];
+    int n = cur.size(), width = std::min(4, n);
+    if (!width)
+        return false;
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return cur[a].getMinV() < cur[b].getMinV(); });
+
+    // 窗口[w, w + width)的删除标记比例
+    auto density = [&](int w) {
+        uint64_t dels = 0, cnt = 0;
+        for (int i = w; i < w + width; ++i) {
+            dels += cur[order[i]].getDelCnt();
+            cnt += cur[order[i]].getCnt();
+        }
+        return cnt ? (double)dels / cnt : 0;
+    };
+
+    int best = 0;
+    if (mode == CompactionPickMode::RoundRobin) {
+        if (cursors.size() <= (size_t)level)
+            cursors.resize(level + 1, 0);
+        // 从游标之后的第一个表开始；游标之后不足一个窗口时回绕到第一个窗口，
+        // 不能退回末尾的窗口，否则上次刚合并过的表会被重复选中
+        best = 0;
+        while (best + width <= n && cur[order[best]].getMinV() <= cursors[level] && cursors[level])
+            best++;
+        if (best + width > n)
+            best = 0;
+        // 删除标记占多数的窗口插队，尽快回收空间
+        double bestDensity = 0.5;
+        for (int w = 0; w + width <= n; ++w) {
+            double d = density(w);
+            if (d > bestDensity) {
+                bestDensity = d;
+                best        = w;
+            }
+        }
+    } else {
+        // 重叠比越小，本次合并重写的下一层数据越少；删除标记比例高的窗口回收收益更大，适当打折
+        double bestScore = -1;
+        std::vector<sstablehead> *next = (level + 1 < levelCount) ? &levels[level + 1] : nullptr;
+        for (int w = 0; w + width <= n; ++w) {
+            uint64_t lo = std::numeric_limits<uint64_t>::max(), hi = 0, inputBytes = 0, overlapBytes = 0;
+            for (int i = w; i < w + width; ++i) {
+                lo = std::min(lo, cur[order[i]].getMinV());
+                hi = std::max(hi, cur[order[i]].getMaxV());
+                inputBytes += cur[order[i]].getBytes();
+            }
+            if (next) {
+                for (sstablehead &it : *next) {
+                    if (!(hi < it.getMinV() || lo > it.getMaxV()))
+                        overlapBytes += it.getBytes();
+                }
+            }
+            double score = (double)overlapBytes / std::max<uint64_t>(inputBytes, 1) / (1 + 4 * density(w));
+            if (bestScore < 0 || score < bestScore) {
+                bestScore = score;
+                best      = w;
+            }
+        }
+    }
+
+    for (int i = best; i < best + width; ++i)
+        job.inputs.push_back(order[i]);
+    if (mode == CompactionPickMode::RoundRobin) {
+        job.advanceCursor = true;
+        job.cursor        = cur[order[best + width - 1]].getMaxV();
+        // 已经轮到本层末尾，下次从头开始
+        if (best + width == n)
+            job.cursor = 0;
+    }
+    return true;
+}
+
+void LeveledCompactionPolicy::installed(const CompactionJob &job) {
+    if (!job.advanceCursor)
+        return;
+    if (cursors.size() <= (size_t)job.level)
+        cursors.resize(job.level + 1, 0);
+    cursors[job.level] = job.cursor;
+    saveCursors();
+}
+
+uint64_t TieredCompactionPolicy::trigger(int level) const {
+    uint64_t res = runsPerLevel;
+    for (int i = 0; i < level && res < (1ull << 40); ++i)
+        res *= runsPerLevel;
+    return res;
+}
+
+double TieredCompactionPolicy::score(std::vector<sstablehead> *levels, int levelCount, int level) {
+    std::vector<std::vector<int>> runs = sortedRuns(levels[level]);
+    double res = (double)runs.size() / trigger(level);
+    if (level + 1 < levelCount)
+        return res;
+    // 最底层：较新各段的总字节数与最旧的段相比，达到1倍时整层合并
+    if (runs.size() < 2)
+        return 0;
+    uint64_t oldest = 0, newer = 0;
+    for (size_t r = 0; r < runs.size(); ++r) {
+        for (int i : runs[r])
+            (r ? newer : oldest) += levels[level][i].getBytes();
+    }
+    return std::max(res, (double)newer / std::max<uint64_t>(oldest, 1));
+}
+
+bool TieredCompactionPolicy::pick(std::vector<sstablehead> *levels, int levelCount, int level, CompactionJob &job) {
+    job.level            = level;
+    job.outputLevel      = level + 1 < levelCount ? level + 1 : level; // 最底层原地合并
+    job.mergeOutputLevel = false;
+    job.inputs.clear();
+    // 整层的所有段合并成下一层（最底层为本层）的一个新段
+    for (int i = 0; i < (int)levels[level].size(); i++)
+        job.inputs.push_back(i);
+    return !job.inputs.empty();
+}
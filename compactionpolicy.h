@@ -0,0 +1,177 @@
+#pragma once
+
+#ifndef LSM_KV_COMPACTIONPOLICY_H
+#define LSM_KV_COMPACTIONPOLICY_H
+#include "options.h"
+#include "sstablehead.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 一次合并任务：把level层的若干表合并进outputLevel层
+ */
+struct CompactionJob {
+    int level       = 0;
+    int outputLevel = 1;
+    std::vector<int> inputs;      // 被选中的表在level层中的下标
+    bool mergeOutputLevel = true; // 是否把输出层中键范围重叠的表一起读入重写
+    // 轮转选表时本层游标的新值：pick只记在这里，合并结果安装后才由installed()生效并落盘
+    bool advanceCursor = false;
+    uint64_t cursor    = 0;
+};
+
+// tables中同一个键最多被几个表的键范围覆盖，即层内点查最多要探测的表数
+int overlapDepth(const std::vector<sstablehead> &tables);
+
+// 把键范围直接或经由其他表间接重叠的表分为一组，组与组的键范围互不相交；按键升序返回各组表的下标
+std::vector<std::vector<int>> overlapGroups(const std::vector<sstablehead> &tables);
+
+// 把tables分成有序段(sorted run)：按时间戳从旧到新，与当前段中的表键范围都不重叠就并入当前段，否则开始新段。
+// 一次合并写出的多个表时间戳相邻、键范围互不相交，归为同一段；按从旧到新返回各段表的下标
+std::vector<std::vector<int>> sortedRuns(const std::vector<sstablehead> &tables);
+
+/**
+ * @brief 合并策略接口：决定哪一层需要合并、选哪些表、各层内的表是否可能重叠，并统计写放大
+ *
+ * levels为每层的表头数组，下标0..levelCount-1，调用方持有索引锁
+ */
+class CompactionPolicy {
+private:
+    std::atomic<uint64_t> flushBytes{0};          // memtable落盘写入的字节数
+    std::atomic<uint64_t> compactionReadBytes{0}; // 合并读入的字节数
+    std::atomic<uint64_t> compactionWriteBytes{0}; // 合并写出的字节数
+
+public:
+    virtual ~CompactionPolicy() = default;
+
+    virtual const char *name() const = 0;
+
+    // 合并紧迫程度，>=1表示该层需要合并
+    virtual double score(std::vector<sstablehead> *levels, int levelCount, int level) = 0;
+
+    // 为level层挑选输入，没有可合并的表时返回false
+    virtual bool pick(std::vector<sstablehead> *levels, int levelCount, int level, CompactionJob &job) = 0;
+
+    // 该层内不同表的键范围是否可能重叠；重叠时get需要查完整层并按时间戳取最新
+    virtual bool levelOverlaps(int level) const = 0;
+
+    // pick选出的job已记入清单并装进索引后调用；合并中途失败则不调用，下次重新选同样的表
+    virtual void installed(const CompactionJob &job) {}
+
+    // 估算尚待合并的字节数，用于写入反压
+    virtual uint64_t pendingBytes(std::vector<sstablehead> *levels, int levelCount);
+
+    // KVStore::reset时调用，清除策略自身持久化的状态
+    virtual void reset() {}
+
+    void recordFlush(uint64_t bytes) {
+        flushBytes += bytes;
+    }
+
+    void recordCompaction(uint64_t readBytes, uint64_t writeBytes) {
+        compactionReadBytes += readBytes;
+        compactionWriteBytes += writeBytes;
+    }
+
+    uint64_t getFlushBytes() const {
+        return flushBytes;
+    }
+
+    uint64_t getCompactionReadBytes() const {
+        return compactionReadBytes;
+    }
+
+    uint64_t getCompactionWriteBytes() const {
+        return compactionWriteBytes;
+    }
+
+    // 写放大 = (flush写入 + 合并写出) / flush写入
+    double writeAmplification() const;
+};
+
+/**
+ * @brief 分层(leveled)合并：第0层文件数达到level0CompactionTrigger时全部下推，第level层字节数超过目标时选出
+ * 按键相邻的至多4个表，与下一层重叠的表一起重写。第1层及以下每层内键范围互不重叠，读放大低、写放大高
+ *
+ * level0Partitions > 1时第0层的表按键范围分区，改按重叠深度（一个键最多落在几个表中）计分，
+ * 只下推深度达到level0CompactionTrigger的重叠组，其余分区留在第0层
+ *
+ * 第level层的目标字节数为 maxBytesForLevelBase * levelSizeRatio^(level-1)；
+ * dynamicLevelBytes时最底层以上的各层改由最底层实际大小反推，不小于一个表的大小
+ *
+ * 第1层及以下的选表方式：
+ * - MinOverlap：选 与下一层重叠字节数/输入字节数 最小的窗口，删除标记比例越高越优先
+ * - RoundRobin：每层一个游标，从上次合并到的键之后继续，之后不足一个窗口时回到本层开头；
+ *   游标在合并结果安装后（installed）才前移并落盘到cursorFile（KVStore放在数据目录下）；
+ *   删除标记比例超过一半的窗口可以插队
+ */
+class LeveledCompactionPolicy : public CompactionPolicy {
+private:
+    CompactionPickMode mode;
+    int level0Trigger;
+    bool partitionedLevel0; // 第0层按键范围分区
+    uint64_t levelBase;
+    double sizeRatio;
+    uint64_t fileSize;
+    bool dynamic;
+    std::string cursorFile;
+    std::vector<uint64_t> cursors; // 每层上次合并到的最大键
+
+    void loadCursors();
+    void saveCursors();
+
+public:
+    explicit LeveledCompactionPolicy(const KVStoreOptions &options = KVStoreOptions(), const std::string &cursorFile = "");
+
+    // 第level层(>=1)的目标字节数
+    uint64_t targetBytes(std::vector<sstablehead> *levels, int levelCount, int level) const;
+
+    const char *name() const override {
+        return "leveled";
+    }
+
+    void reset() override;
+
+    double score(std::vector<sstablehead> *levels, int levelCount, int level) override;
+    bool pick(std::vector<sstablehead> *levels, int levelCount, int level, CompactionJob &job) override;
+    void installed(const CompactionJob &job) override;
+
+    bool levelOverlaps(int level) const override {
+        return level == 0;
+    }
+};
+
+/**
+ * @brief 分级(size-tiered/universal)合并：第level层的有序段(run)数达到runsPerLevel^(level+1)时
+ * 把整层合并成下一层的一个新段，不读写下一层已有的段。段数按sortedRuns计，
+ * 一次合并按targetFileSize切成的多个表只算一段。
+ *
+ * 最底层（levelCount-1）没有下一层，改为整层原地合并成一段：较新各段的总字节数达到最旧段的字节数
+ * （空间放大到2倍），或段数达到上述阈值时触发。
+ * 每个字节在最底层以上每层只写一次，写放大低；代价是每层内有多个重叠的段，读放大高
+ */
+class TieredCompactionPolicy : public CompactionPolicy {
+private:
+    int runsPerLevel;
+
+    uint64_t trigger(int level) const; // 第level层触发合并的段数
+
+public:
+    explicit TieredCompactionPolicy(int runsPerLevel = 4) : runsPerLevel(std::max(2, runsPerLevel)) {}
+
+    const char *name() const override {
+        return "tiered";
+    }
+
+    double score(std::vector<sstablehead> *levels, int levelCount, int level) override;
+    bool pick(std::vector<sstablehead> *levels, int levelCount, int level, CompactionJob &job) override;
+
+    bool levelOverlaps(int level) const override {
+        return true;
+    }
+};
+
+#endif // LSM_KV_COMPACTIONPOLICY_H
@@ -0,0 +1,42 @@
+#include "hashindex.h"
+
+#include <algorithm>
+
+HashIndex::HashIndex(uint64_t memoryBytes) : slots(memoryBytes / sizeof(uint64_t), EMPTY) {}
+
+void HashIndex::clear() {
+    std::fill(slots.begin(), slots.end(), EMPTY);
+    used = tombstones = 0;
+    complete = true;
+    rebuild  = false;
+    ids.clear();
+    freeIds.clear();
+    nextId = 1;
+}
+
+uint32_t HashIndex::addTable(uint64_t time) {
+    uint32_t id;
+    if (!freeIds.empty()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+    } else if (nextId <= MAX_POS) {
+        id = nextId++;
+    } else {
+        return 0;
+    }
+    ids[time] = id;
+    return id;
+}
+
+void HashIndex::removeTable(uint64_t time) {
+    auto it = ids.find(time);
+    if (it == ids.end())
+        return;
+    freeIds.push_back(it->second);
+    ids.erase(it);
+}
+
+uint32_t HashIndex::tableId(uint64_t time) const {
+    auto it = ids.find(time);
+    return it == ids.end() ? 0 : it->second;
+}
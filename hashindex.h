@@ -0,0 +1,173 @@
+#pragma once
+
+#ifndef LSM_KV_HASHINDEX_H
+#define LSM_KV_HASHINDEX_H
+
+#include "bloom.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief 覆盖所有层的全局哈希索引：键 -> (表编号, 表内下标)，只指向键的最新版本
+ *
+ * 开放寻址、线性探测，每个槽8字节：高16位为键哈希的标签，中间24位为表编号（从1开始），低24位为表内下标。
+ * 槽中不存键，标签相同时由调用方的match(表编号, 下标)读表的索引确认键，不会因标签冲突返回错误的表。
+ * 槽数由内存上限决定，装不下时不再插入新键并标记为不完整：之后查不到的键要退回逐层查找，
+ * 已有的槽仍然正确（同一个键总是原地覆盖）。删除留下墓碑，墓碑过多导致插入失败时needsRebuild()为true，
+ * 由调用方清空后按全部表重建。
+ * 不加锁，调用方负责同步（KVStore在indexMutex独占锁下修改，共享锁下查找）
+ */
+class HashIndex {
+private:
+    static constexpr uint64_t EMPTY     = 0;
+    static constexpr uint64_t TOMBSTONE = 1; // 表编号为0，不会与有效的槽相同
+
+    std::vector<uint64_t> slots;
+    size_t used = 0, tombstones = 0;
+    bool complete = true, rebuild = false;
+
+    std::unordered_map<uint64_t, uint32_t> ids; // 表的时间戳 -> 表编号
+    std::vector<uint32_t> freeIds;
+    uint32_t nextId = 1;
+
+    static uint64_t pack(uint16_t tag, uint32_t id, uint32_t pos) {
+        return (uint64_t)tag << 48 | (uint64_t)id << 24 | pos;
+    }
+
+    static uint16_t tagOf(uint64_t h) {
+        return h >> 48;
+    }
+
+    size_t home(uint64_t h) const {
+        return h % slots.size();
+    }
+
+public:
+    static constexpr uint32_t MAX_POS = (1u << 24) - 1; // 表内下标和表编号的上限
+
+    explicit HashIndex(uint64_t memoryBytes);
+
+    void clear();
+
+    // 为时间戳为time的表分配编号，编号用尽时返回0
+    uint32_t addTable(uint64_t time);
+    // 回收表的编号，调用方需已删掉指向它的所有槽
+    void removeTable(uint64_t time);
+    uint32_t tableId(uint64_t time) const;
+
+    uint32_t idLimit() const {
+        return nextId;
+    }
+
+    uint32_t fileOf(size_t slot) const {
+        return slots[slot] >> 24 & MAX_POS;
+    }
+
+    uint32_t posOf(size_t slot) const {
+        return slots[slot] & MAX_POS;
+    }
+
+    /**
+     * @brief 查找key所在的槽
+     * @param match match(表编号, 下标)判断该位置是否确实是key
+     * @return 槽号，不存在返回-1
+     */
+    template <class Match> int64_t find(uint64_t key, Match &&match) const {
+        if (slots.empty())
+            return -1;
+        uint64_t h = mix64(key);
+        uint16_t tag = tagOf(h);
+        for (size_t n = 0, i = home(h); n < slots.size(); ++n, i = i + 1 == slots.size() ? 0 : i + 1) {
+            uint64_t s = slots[i];
+            if (s == EMPTY)
+                return -1;
+            if (s != TOMBSTONE && tagOf(s) == tag && match(fileOf(i), posOf(i)))
+                return i;
+        }
+        return -1;
+    }
+
+    /**
+     * @brief 插入或覆盖key的位置；key已有槽时总能覆盖，新键在超过装载上限时插入失败
+     * @return 是否成功；失败时索引变为不完整，key原有的槽被删掉，不会留下指向旧版本的槽
+     */
+    template <class Match> bool put(uint64_t key, uint32_t id, uint32_t pos, Match &&match) {
+        if (slots.empty()) {
+            complete = false;
+            return false;
+        }
+        bool valid = id && pos <= MAX_POS;
+        uint64_t h = mix64(key);
+        uint16_t tag = tagOf(h);
+        int64_t free = -1; // 探测路径上的第一个墓碑
+        size_t i = home(h);
+        for (size_t n = 0; n < slots.size(); ++n, i = i + 1 == slots.size() ? 0 : i + 1) {
+            uint64_t s = slots[i];
+            if (s == EMPTY)
+                break;
+            if (s == TOMBSTONE) {
+                if (free < 0)
+                    free = i;
+                continue;
+            }
+            if (tagOf(s) == tag && match(fileOf(i), posOf(i))) {
+                if (!valid) {
+                    erase(i);
+                    break;
+                }
+                slots[i] = pack(tag, id, pos);
+                return true;
+            }
+        }
+        // 装载因子超过0.9后线性探测的路径变长，不再插入
+        if (!valid || ((used + tombstones + 1) * 10 > slots.size() * 9 && free < 0)) {
+            complete = false;
+            rebuild  = tombstones >= slots.size() / 8;
+            return false;
+        }
+        if (free >= 0) {
+            i = free;
+            tombstones--;
+        }
+        slots[i] = pack(tag, id, pos);
+        used++;
+        return true;
+    }
+
+    // 覆盖find得到的槽，key必须是该槽原来的键
+    void set(size_t slot, uint64_t key, uint32_t id, uint32_t pos) {
+        slots[slot] = pack(tagOf(mix64(key)), id, pos);
+    }
+
+    void erase(size_t slot) {
+        slots[slot] = TOMBSTONE;
+        used--;
+        tombstones++;
+    }
+
+    // 删掉了仍然存在的键的槽之后调用
+    void markIncomplete() {
+        complete = false;
+    }
+
+    // 是否每个表中的每个键都有槽；为false时查不到的键可能存在
+    bool isComplete() const {
+        return complete;
+    }
+
+    bool needsRebuild() const {
+        return rebuild;
+    }
+
+    size_t size() const {
+        return used;
+    }
+
+    size_t capacity() const {
+        return slots.size();
+    }
+};
+
+#endif // LSM_KV_HASHINDEX_H
@@ -0,0 +1,125 @@
+#include "hashvector.h"
+
+#include "ThreadPool.h"
+#include "bloom.h"
+
+#include <algorithm>
+
+size_t hashvector::probe(uint64_t key) const {
+    size_t mask = slots.size() - 1;
+    size_t i    = mix64(key) & mask;
+    while (slots[i] && entries[slots[i] - 1].first != key)
+        i = (i + 1) & mask;
+    return i;
+}
+
+void hashvector::grow() {
+    slots.assign(slots.empty() ? 1024 : slots.size() * 2, 0);
+    size_t mask = slots.size() - 1;
+    for (uint32_t j = 0; j < entries.size(); ++j) {
+        size_t i = mix64(entries[j].first) & mask;
+        while (slots[i])
+            i = (i + 1) & mask;
+        slots[i] = j + 1;
+    }
+}
+
+void hashvector::insert(uint64_t key, const std::string &str) {
+    if (2 * (entries.size() + 1) > slots.size())
+        grow();
+    size_t i = probe(key);
+    if (slots[i]) { // 插入的key已存在，则更新值即可
+        std::string &val = entries[slots[i] - 1].second;
+        bytes            = bytes - val.size() + str.size();
+        val              = str;
+        return;
+    }
+    slots[i] = entries.size() + 1;
+    entries.emplace_back(key, str);
+    bytes += 12 + str.size(); // key为64位，offset为32位，再加上value的大小
+    sorted = false;
+}
+
+std::string hashvector::search(uint64_t key) {
+    if (slots.empty())
+        return "";
+    size_t i = probe(key);
+    return slots[i] ? entries[slots[i] - 1].second : "";
+}
+
+void hashvector::scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) {
+    if (sorted) {
+        auto it = std::lower_bound(order.begin(), order.end(), std::make_pair(key1, (uint32_t)0));
+        for (; it != order.end() && it->first <= key2; ++it)
+            list.push_back(entries[it->second]);
+        return;
+    }
+    // 只排序区间内的条目，不为一次范围查询排序整个memtable
+    size_t begin = list.size();
+    for (auto &entry : entries) {
+        if (entry.first >= key1 && entry.first <= key2)
+            list.push_back(entry);
+    }
+    std::sort(list.begin() + begin, list.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+}
+
+void hashvector::sort() {
+    if (sorted)
+        return;
+    order.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+        order[i] = {entries[i].first, (uint32_t)i};
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t runs    = std::min(threads, order.size() / (PARALLEL_SORT_MIN / 4));
+    if (order.size() < PARALLEL_SORT_MIN || runs <= 1) {
+        std::sort(order.begin(), order.end());
+        sorted = true;
+        return;
+    }
+    // 分成runs段各自排序，再逐轮两两归并相邻的段，每轮的归并互不相关，并行执行
+    std::vector<size_t> bounds;
+    for (size_t i = 0; i <= runs; ++i)
+        bounds.push_back(order.size() * i / runs);
+    ThreadPool pool(runs);
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < runs; ++i) {
+        futures.push_back(pool.enqueue(
+            [this, &bounds, i] { std::sort(order.begin() + bounds[i], order.begin() + bounds[i + 1]); }));
+    }
+    for (auto &fut : futures)
+        fut.get();
+    while (bounds.size() > 2) {
+        futures.clear();
+        std::vector<size_t> next;
+        for (size_t i = 0; i + 1 < bounds.size(); i += 2) {
+            next.push_back(bounds[i]);
+            if (i + 2 < bounds.size()) {
+                futures.push_back(pool.enqueue([this, &bounds, i] {
+                    std::inplace_merge(order.begin() + bounds[i], order.begin() + bounds[i + 1],
+                                       order.begin() + bounds[i + 2]);
+                }));
+            }
+        }
+        next.push_back(bounds.back());
+        for (auto &fut : futures)
+            fut.get();
+        bounds = next;
+    }
+    sorted = true;
+}
+
+void hashvector::forEach(uint64_t key1, uint64_t key2, const std::function<void(uint64_t, const std::string &)> &fn) {
+    sort();
+    auto it = std::lower_bound(order.begin(), order.end(), std::make_pair(key1, (uint32_t)0));
+    for (; it != order.end() && it->first <= key2; ++it)
+        fn(it->first, entries[it->second].second);
+}
+
+void hashvector::reset() {
+    entries.clear();
+    std::fill(slots.begin(), slots.end(), 0); // 保留容量，下一个memtable通常一样大
+    order.clear();
+    sorted = true;
+    bytes  = 0;
+}
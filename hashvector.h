@@ -0,0 +1,54 @@
+#pragma once
+
+#ifndef LSM_KV_HASHVECTOR_H
+#define LSM_KV_HASHVECTOR_H
+
+#include "memtable.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief 只追加的memtable：条目按写入顺序追加到数组，哈希表记录每个键的下标，用于点查和覆盖
+ *
+ * 哈希表只存32位下标，键从entries中取，装载率不超过1/2，插入不分配节点
+ *
+ * 写入不维护顺序，只有需要有序时才排序：落盘（forEach）时对(键, 下标)数组并行排序，
+ * 结果一直保留到下一次插入新键；范围查询只挑出区间内的条目再排序。
+ * 适合写入后直到落盘都很少读的批量导入
+ */
+class hashvector : public memtable {
+private:
+    std::vector<std::pair<uint64_t, std::string>> entries; // 写入顺序
+    std::vector<uint32_t> slots; // 开放寻址（线性探测）的哈希表，存entries中的下标 + 1，0表示空
+    std::vector<std::pair<uint64_t, uint32_t>> order;      // 按键排序的(键, 下标)，sorted为false时无效
+    bool sorted    = true;
+    uint32_t bytes = 0; // 与跳表相同，12 * 条目数 + 值的总长
+
+    size_t probe(uint64_t key) const; // 返回key所在的槽，不存在时返回探测到的空槽
+    void grow();                      // 容量翻倍并重新插入所有下标
+    void sort();                      // 条目多时分块并行排序再归并
+
+public:
+    static constexpr size_t PARALLEL_SORT_MIN = 1 << 16; // 少于这么多条时单线程排序
+
+    void insert(uint64_t key, const std::string &str) override;
+    std::string search(uint64_t key) override;
+    void scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) override;
+    void reset() override;
+
+    uint32_t getBytes() override {
+        return bytes;
+    }
+
+    bool empty() override {
+        return entries.empty();
+    }
+
+    using memtable::forEach;
+    void forEach(uint64_t key1, uint64_t key2, const std::function<void(uint64_t, const std::string &)> &fn) override;
+};
+
+#endif // LSM_KV_HASHVECTOR_H
@@ -3,54 +3,160 @@
 #include "skiplist.h"
 #include "sstable.h"
 #include "utils.h"
+#include "ThreadPool.h"
+#include "compactionfilter.h"
+#include "losertree.h"
+#include "metacache.h"
+#include "mergeoperator.h"
+#include "ratelimiter.h"
+#include "sstablestream.h"
+#include "ttl.h"
 
 #include <algorithm>
 #include <chrono>  // 添加chrono库用于精确计时
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <queue>
 #include <string>
+#include <thread>
+#include <unordered_set>
 #include <utility>
 
-static const std::string DEL = "~DELETED~";
-const uint32_t MAXSIZE       = 2 * 1024 * 1024;
 
-struct poi {
-    int sstableId; // vector中第几个sstable
-    int pos;       // 该sstable的第几个key-offset
-    uint64_t time;
-    Index index;
-};
+/**
+ * @brief 读路径上判断一个值是否可见：空值、删除标记和已过期的值不可见；带过期时间的值剥去编码头
+ */
+static bool liveValue(std::string &value, uint64_t now) {
+    if (!value.length() || value == DEL || isExpired(value, now))
+        return false;
+    if (hasTTL(value))
+        value = std::string(ttlValue(value));
+    return true;
+}
 
-struct cmpPoi {
-    bool operator()(const poi &a, const poi &b) {
-        if (a.index.key == b.index.key)
-            return a.time < b.time;
-        return a.index.key > b.index.key;
+// 同上，在值的视图上剥去编码头，不复制
+static bool liveValue(std::string_view &value, uint64_t now) {
+    if (value.empty() || value == DEL || isExpired(value, now))
+        return false;
+    if (hasTTL(value))
+        value = ttlValue(value);
+    return true;
+}
+
+/**
+ * @brief 在临时线程池上并行执行load(0..n-1)，用于读取表头；只有一个任务时直接在当前线程执行
+ */
+static void parallelLoad(size_t n, const std::function<void(size_t)> &load) {
+    size_t threads = std::min<size_t>(n, std::max(1u, std::thread::hardware_concurrency()));
+    if (threads <= 1) {
+        for (size_t i = 0; i < n; ++i)
+            load(i);
+        return;
     }
-};
+    ThreadPool pool(threads);
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < n; ++i)
+        futures.push_back(pool.enqueue(load, i));
+    for (auto &fut : futures)
+        fut.get();
+}
 
-KVStore::KVStore(const std::string &dir) :
-    KVStoreAPI(dir) // read from sstables
+KVStore::KVStore(const std::string &dir, const KVStoreOptions &options) :
+    KVStoreAPI(dir), options(options) // read from sstables
 {
     hnswIndex = new HNSWIndex();
-    for (totalLevel = 0;; ++totalLevel) {
-        std::string path = dir + "/level-" + std::to_string(totalLevel) + "/";
-        std::vector<std::string> files;
-        if (!utils::dirExists(path)) {
-            totalLevel--;
-            break; // stop read
-        }
-        int nums = utils::scanDir(path, files);
+    s         = newMemtable(options.memtableType);
+    if (options.compactionPolicy)
+        policy = options.compactionPolicy;
+    else if (options.compactionStyle == CompactionStyle::Tiered)
+        policy = std::make_shared<TieredCompactionPolicy>(options.tieredRunsPerLevel);
+    else
+        policy = std::make_shared<LeveledCompactionPolicy>(options, dir + "/compaction_cursor");
+    if (options.backgroundCompaction)
+        compactionPool = new ThreadPool(std::max(1, options.compactionThreads));
+    sstableIndex.resize(std::max(2, options.levelCount));
+    manifest = std::make_unique<Manifest>(dir + "/MANIFEST");
+    std::vector<std::vector<TableMeta>> metas;
+    uint64_t maxTime;
+    if (manifest->replay(metas, maxTime)) {
+        // 由清单恢复：只建立表头的元数据，bloom和索引在第一次访问时再读入
+        if (metas.size() > sstableIndex.size())
+            sstableIndex.resize(metas.size());
         sstablehead cur;
-        for (int i = 0; i < nums; ++i) {       // 读每一个文件头
-            std::string url = path + files[i]; // url, 每一个文件名
-            cur.loadFileHead(url.data());
-            sstableIndex[totalLevel].push_back(cur);
-            TIME = std::max(TIME, cur.getTime()); // 更新时间戳
+        for (size_t level = 0; level < metas.size(); ++level) {
+            for (auto &meta : metas[level]) {
+                cur.loadMeta(meta.filename, meta.time, meta.cnt, meta.minV, meta.maxV, meta.bytes, meta.delCnt,
+                             meta.bloomHash);
+                cur.partition(options.metadataCache.get());
+                sstableIndex[level].push_back(cur);
+            }
+        }
+        TIME = std::max(TIME.load(), maxTime);
+        for (totalLevel = 0;; ++totalLevel) {
+            std::string path = dir + "/level-" + std::to_string(totalLevel) + "/";
+            std::vector<std::string> files;
+            if (!utils::dirExists(path)) {
+                totalLevel--;
+                break;
+            }
+            if (totalLevel >= (int)sstableIndex.size())
+                sstableIndex.resize(totalLevel + 1);
+            // 不在清单中的文件是崩溃时未提交的合并输出，或已提交但还没删掉的合并输入
+            std::set<std::string> live;
+            for (auto &head : sstableIndex[totalLevel]) {
+                std::string name = head.getFilename();
+                live.insert(name.substr(name.find_last_of('/') + 1));
+            }
+            int nums = utils::scanDir(path, files);
+            for (int i = 0; i < nums; ++i) {
+                if (!live.count(files[i]))
+                    utils::rmfile((path + files[i]).data());
+            }
+        }
+    } else {
+        // 没有清单（旧版本的数据目录），或清单的快照损坏：读取每个文件头，再写出清单；不删除任何文件
+        std::vector<std::pair<int, std::string>> urls; // (层号, 文件名)
+        for (totalLevel = 0;; ++totalLevel) {
+            std::string path = dir + "/level-" + std::to_string(totalLevel) + "/";
+            std::vector<std::string> files;
+            if (!utils::dirExists(path)) {
+                totalLevel--;
+                break; // stop read
+            }
+            int nums = utils::scanDir(path, files);
+            // 磁盘上已有的层数多于配置时，保留已有的层
+            if (totalLevel >= (int)sstableIndex.size())
+                sstableIndex.resize(totalLevel + 1);
+            for (int i = 0; i < nums; ++i) {
+                std::string name = path + files[i];
+                std::string spill = sstablewriter::SPILL_SUFFIX;
+                if (name.size() > spill.size() && name.compare(name.size() - spill.size(), spill.size(), spill) == 0) {
+                    utils::rmfile(name.data()); // 崩溃时未写完的合并输出的暂存数据
+                    continue;
+                }
+                urls.push_back({totalLevel, name}); // url, 每一个文件名
+            }
+        }
+        // 各文件头互不相关，并行读取
+        std::vector<sstablehead> heads(urls.size());
+        parallelLoad(urls.size(), [&](size_t i) { heads[i].loadFileHead(urls[i].second.data()); });
+        for (size_t i = 0; i < heads.size(); ++i) {
+            if (options.metadataCache)
+                heads[i].partition(options.metadataCache.get());
+            sstableIndex[urls[i].first].push_back(heads[i]);
+            TIME = std::max(TIME.load(), heads[i].getTime()); // 更新时间戳
         }
     }
+    // 每次打开都重写一份快照，丢掉上次运行积累的修改记录
+    writeManifestSnapshot();
+    allocateFilters();
+    if (options.hashIndexBytes) {
+        hashIndex = std::make_unique<HashIndex>(options.hashIndexBytes);
+        rebuildHashIndex();
+    }
 
     // 启动时加载HNSW
     // load_hnsw_index_from_disk();
@@ -60,21 +166,357 @@ KVStore::KVStore(const std::string &dir) :
 KVStore::~KVStore()
 {
 
-    // 退出时保存嵌入向量和HNSW索引
+    if (flushMemtable())
+        compaction(); // 从0层开始尝试合并
+
+    // 后台模式下等合并全部落盘后再销毁线程池
+    waitForCompaction();
+    delete compactionPool;
+
+    // 退出时同步合并过滤器丢弃的键，再保存嵌入向量和HNSW索引
+    applyFilteredKeys();
     save_embedding_to_disk();
     save_hnsw_index_to_disk();
+}
+
+static TableMeta tableMeta(int level, sstablehead &head) {
+    TableMeta meta;
+    meta.level     = level;
+    meta.filename  = head.getFilename();
+    meta.time      = head.getTime();
+    meta.cnt       = head.getCnt();
+    meta.minV      = head.getMinV();
+    meta.maxV      = head.getMaxV();
+    meta.delCnt    = head.getDelCnt();
+    meta.bytes     = head.getBytes();
+    meta.bloomHash = head.getBloomHash();
+    return meta;
+}
+
+void KVStore::logEdit(VersionEdit &edit) {
+    edit.maxTime = TIME;
+    manifest->append(edit);
+}
+
+void KVStore::maybeSnapshotManifest() {
+    if (manifest->needsSnapshot())
+        writeManifestSnapshot();
+}
+
+void KVStore::writeManifestSnapshot() {
+    std::vector<std::vector<TableMeta>> metas(sstableIndex.size());
+    for (size_t level = 0; level < sstableIndex.size(); ++level) {
+        for (auto &head : sstableIndex[level])
+            metas[level].push_back(tableMeta(level, head));
+    }
+    manifest->snapshot(metas, TIME);
+}
+
+void KVStore::loadHeads(std::shared_lock<std::shared_mutex> &lock, uint64_t key1, uint64_t key2) {
+    auto pending = [&] {
+        for (int level = 0; level <= totalLevel; ++level) {
+            for (sstablehead &it : sstableIndex[level]) {
+                if (!it.isLoaded() && key1 <= it.getMaxV() && key2 >= it.getMinV())
+                    return true;
+            }
+        }
+        return false;
+    };
+    // 放开读锁到重新拿到读锁之间sstableIndex可能被修改，所以重新检查直到全部已读入
+    while (pending()) {
+        lock.unlock();
+        {
+            std::unique_lock<std::shared_mutex> writeLock(indexMutex);
+            std::vector<std::pair<sstablehead *, int>> heads; // (表头, 层号)
+            for (int level = 0; level <= totalLevel; ++level) {
+                for (sstablehead &it : sstableIndex[level]) {
+                    if (!it.isLoaded() && key1 <= it.getMaxV() && key2 >= it.getMinV())
+                        heads.push_back({&it, level});
+                }
+            }
+            // 范围查询可能一次涉及很多表，并行读入
+            parallelLoad(heads.size(), [&](size_t i) {
+                heads[i].first->ensureLoaded();
+                fitFilter(*heads[i].first, heads[i].second);
+            });
+        }
+        lock.lock();
+    }
+}
+
+bool KVStore::filterTuning() const {
+    return !options.bloomBitsPerKey.empty() || options.bloomMemoryBudget || options.bloomSkipLastLevel;
+}
+
+void KVStore::fitFilter(sstablehead &head, int level) {
+    if (!filterTuning())
+        return;
+    double bitsPerKey = level < (int)levelBitsPerKey.size() ? levelBitsPerKey[level] : -1;
+    // 按内存预算分配时向下取，保证总量不超预算
+    uint32_t size = bloom::sizeFor(bitsPerKey, head.getCnt(), options.bloomMemoryBudget != 0);
+    uint32_t cur  = head.getFilterSize();
+    if (size == cur)
+        return;
+    // 能直接折叠时总是调整；需要从文件重读时，只在大小至少相差一倍时才做，避免分配的小幅波动反复读盘
+    bool foldable = size < cur && (size == 0 || cur % size == 0);
+    if (!foldable && cur && size > cur / 2 && size < cur * 2)
+        return;
+    head.fitFilter(size);
+}
+
+/**
+ * @brief 按选项重新计算各层的每键位数，并调整所有已读入的表
+ *
+ * Monkey模式下分配依赖各层的条目数，所以每次表增删后都重新计算；调整多数只是折叠，不读盘
+ */
+void KVStore::allocateFilters() {
+    if (!filterTuning())
+        return;
+    int levels = sstableIndex.size();
+    int last   = -1; // 最底的非空层
+    for (int level = 0; level < levels; ++level) {
+        if (!sstableIndex[level].empty())
+            last = level;
+    }
+    bool skipLast = options.bloomSkipLastLevel && last > 0;
+    levelBitsPerKey.assign(levels, -1);
+    if (options.bloomMemoryBudget) {
+        std::vector<uint64_t> entries(levels, 0);
+        std::vector<double> maxBits(levels, 0);
+        for (int level = 0; level < levels; ++level) {
+            if (skipLast && level == last)
+                continue;
+            for (auto &head : sstableIndex[level])
+                entries[level] += head.getCnt();
+            if (entries[level])
+                maxBits[level] = 8.0 * M * sstableIndex[level].size() / entries[level];
+        }
+        levelBitsPerKey = allocateBloomBits(entries, maxBits, options.bloomMemoryBudget * 8.0);
+    } else if (!options.bloomBitsPerKey.empty()) {
+        for (int level = 0; level < levels; ++level)
+            levelBitsPerKey[level] = options.bloomBitsPerKey[std::min<size_t>(level, options.bloomBitsPerKey.size() - 1)];
+    }
+    if (skipLast)
+        levelBitsPerKey[last] = 0;
+    for (int level = 0; level < levels; ++level) {
+        for (auto &head : sstableIndex[level])
+            fitFilter(head, level);
+    }
+}
+
+uint64_t KVStore::filterMemory() {
+    std::shared_lock<std::shared_mutex> lock(indexMutex);
+    uint64_t res = 0;
+    for (auto &level : sstableIndex) {
+        for (auto &head : level) {
+            if (head.isLoaded() && !head.isPartitioned())
+                res += head.getFilterSize();
+        }
+    }
+    return res;
+}
+
+bool KVStore::hashMatch(uint64_t key, uint32_t id, uint32_t pos) {
+    sstablehead *head = id < hashTables.size() ? hashTables[id] : nullptr;
+    return head && pos < head->getCnt() && head->getKey(pos) == key;
+}
+
+void KVStore::refreshHashTables() {
+    hashTables.assign(hashIndex->idLimit(), nullptr);
+    for (auto &level : sstableIndex) {
+        for (auto &head : level) {
+            uint32_t id = hashIndex->tableId(head.getTime());
+            if (id)
+                hashTables[id] = &head;
+        }
+    }
+}
 
+/**
+ * @brief 按全部表重建哈希索引，调用方需持有indexMutex独占锁（或在构造函数中）
+ *
+ * 从最底层往上、层内按时间戳从旧到新加入，同一个键后加入的版本更新，覆盖之前的槽
+ */
+void KVStore::rebuildHashIndex() {
+    std::vector<std::pair<sstablehead *, int>> heads; // 需要索引，先读入还没读入的表
+    for (int level = 0; level < (int)sstableIndex.size(); ++level) {
+        for (auto &head : sstableIndex[level]) {
+            if (!head.isLoaded())
+                heads.push_back({&head, level});
+        }
+    }
+    parallelLoad(heads.size(), [&](size_t i) {
+        heads[i].first->ensureLoaded();
+        fitFilter(*heads[i].first, heads[i].second);
+    });
+    hashIndex->clear();
+    hashTables.clear();
+    for (int level = sstableIndex.size() - 1; level >= 0; --level) {
+        std::vector<sstablehead *> tables;
+        for (auto &head : sstableIndex[level])
+            tables.push_back(&head);
+        std::sort(tables.begin(), tables.end(),
+                  [](sstablehead *a, sstablehead *b) { return a->getTime() < b->getTime(); });
+        for (auto *head : tables)
+            hashIndexAdd(*head);
+    }
+}
 
-    sstable ss(s);
-    if (!ss.getCnt())
-        return; // empty sstable
-    std::string path = std::string("./data/level-0/");
-    if (!utils::dirExists(path)) {
-        utils::_mkdir(path.data());
-        totalLevel = 0;
+void KVStore::hashIndexAdd(sstablehead &head) {
+    uint32_t id = hashIndex->addTable(head.getTime());
+    if (id >= hashTables.size())
+        hashTables.resize(id + 1, nullptr);
+    hashTables[id] = &head;
+    for (uint64_t i = 0; i < head.getCnt(); ++i) {
+        uint64_t key = head.getKey(i);
+        hashIndex->put(key, id, i, [&](uint32_t id, uint32_t pos) { return hashMatch(key, id, pos); });
     }
-    ss.putFile(ss.getFilename().data());
-    compaction(); // 从0层开始尝试合并
+}
+
+/**
+ * @brief 合并结果安装前更新哈希索引，调用方需持有indexMutex独占锁，inputs仍在sstableIndex中
+ *
+ * 只改指向输入表的槽：合并期间flush的新表中的键已指向更新的版本。
+ * 索引不完整时输出中没有槽的键保持没有槽，避免插入一个比未索引的版本更旧的位置
+ */
+void KVStore::hashIndexReplace(std::vector<sstablehead> &inputs, std::vector<sstablehead> &outputs) {
+    std::set<uint32_t> inputIds;
+    for (auto &head : inputs) {
+        if (uint32_t id = hashIndex->tableId(head.getTime()))
+            inputIds.insert(id);
+    }
+    auto findInput = [&](uint64_t key) {
+        int64_t slot = hashIndex->find(key, [&](uint32_t id, uint32_t pos) { return hashMatch(key, id, pos); });
+        return slot >= 0 && inputIds.count(hashIndex->fileOf(slot)) ? slot : -1;
+    };
+    for (auto &head : outputs) {
+        uint32_t id = hashIndex->addTable(head.getTime());
+        if (id >= hashTables.size())
+            hashTables.resize(id + 1, nullptr);
+        if (id)
+            hashTables[id] = &head;
+        for (uint64_t i = 0; i < head.getCnt(); ++i) {
+            uint64_t key = head.getKey(i);
+            int64_t slot = findInput(key);
+            if (slot < 0)
+                continue;
+            if (id && i <= HashIndex::MAX_POS) {
+                hashIndex->set(slot, key, id, i);
+            } else {
+                hashIndex->erase(slot);
+                hashIndex->markIncomplete();
+            }
+        }
+    }
+    // 输入表中剩下的槽是合并中丢弃的键
+    for (auto &head : inputs) {
+        for (uint64_t i = 0; i < head.getCnt(); ++i) {
+            int64_t slot = findInput(head.getKey(i));
+            if (slot >= 0)
+                hashIndex->erase(slot);
+        }
+    }
+    for (auto &head : inputs)
+        hashIndex->removeTable(head.getTime());
+}
+
+/**
+ * @brief 第0层分区时flush的切点，分区i为[cuts[i - 1], cuts[i] - 1]；不分区时返回空
+ *
+ * 第1层的表够多时从第1层表的最小键中均匀挑出切点，每个分区之后只与第1层的一段相邻表重叠；
+ * 否则按memtable中的键数均分
+ */
+std::vector<uint64_t> KVStore::flushBoundaries() {
+    std::vector<uint64_t> cuts;
+    int parts = options.level0Partitions;
+    // 第1层内本身可能重叠时，对齐第1层没有意义
+    if (parts <= 1 || policy->levelOverlaps(1))
+        return cuts;
+    {
+        std::shared_lock<std::shared_mutex> lock(indexMutex);
+        if (sstableIndex.size() > 1) {
+            for (auto &head : sstableIndex[1])
+                cuts.push_back(head.getMinV());
+        }
+    }
+    std::sort(cuts.begin(), cuts.end());
+    if (!cuts.empty())
+        cuts.erase(cuts.begin()); // 第一个表之前的键归入第一个分区
+    std::vector<uint64_t> picked;
+    if ((int)cuts.size() + 1 >= parts) {
+        for (int i = 1; i < parts; ++i)
+            picked.push_back(cuts[(cuts.size() + 1) * i / parts - 1]);
+    } else {
+        std::vector<uint64_t> keys;
+        s->forEach([&](uint64_t key, const std::string &) { keys.push_back(key); });
+        for (int i = 1; i < parts; ++i)
+            picked.push_back(keys[keys.size() * i / parts]);
+    }
+    picked.erase(std::unique(picked.begin(), picked.end()), picked.end());
+    if (!picked.empty() && picked[0] == 0)
+        picked.erase(picked.begin());
+    return picked;
+}
+
+/**
+ * @brief 把memtable写成第0层的新SSTable并清空memtable；第0层分区时按flushBoundaries切成多个表
+ * @return memtable为空时不写文件，返回false
+ */
+bool KVStore::flushMemtable() {
+    if (s->empty())
+        return false;
+    std::string path = "./data/level-0";
+    if (!utils::dirExists(path))
+        utils::mkdir(path.data());
+    std::vector<uint64_t> cuts = flushBoundaries();
+    // 直接从memtable流式写盘，在持锁之前写完，写盘和限速等待都不阻塞读者；
+    // 安装之前崩溃留下的文件不在清单中，重新打开时会被删掉。同一次flush的表键范围互不相交
+    std::vector<sstablehead> heads;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i <= cuts.size(); ++i) {
+        uint64_t lo = i ? cuts[i - 1] : 0, hi = i < cuts.size() ? cuts[i] - 1 : UINT64_MAX;
+        uint64_t time = ++TIME;
+        memtablewriter writer(s, path + "/" + std::to_string(time) + ".sst", time, options.bloomHash, 1 << 20,
+                              options.rateLimiter.get(), lo, hi);
+        if (!writer.getCnt())
+            continue;
+        try {
+            heads.push_back(writer.finish());
+        } catch (...) { // 写盘失败时memtable保持不变，删掉本次已写出的分区
+            for (auto &head : heads)
+                utils::rmfile(head.getFilename().data());
+            throw;
+        }
+        bytes += heads.back().getBytes();
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(indexMutex);
+        // 清单写失败时抛出，新表不安装，memtable也不清空
+        VersionEdit edit;
+        for (auto &head : heads)
+            edit.added.push_back(tableMeta(0, head));
+        logEdit(edit);
+        totalLevel = std::max(totalLevel, 0);
+        size_t first = sstableIndex[0].size();
+        sstableIndex[0].insert(sstableIndex[0].end(), heads.begin(), heads.end()); // 加入缓存
+        if (hashIndex) {
+            refreshHashTables(); // 插入可能使旧的表头指针失效
+            for (size_t i = first; i < sstableIndex[0].size(); ++i)
+                hashIndexAdd(sstableIndex[0][i]);
+            if (hashIndex->needsRebuild())
+                rebuildHashIndex();
+        }
+        if (options.metadataCache) {
+            for (size_t i = first; i < sstableIndex[0].size(); ++i)
+                sstableIndex[0][i].partition(options.metadataCache.get());
+        }
+        allocateFilters();
+        maybeSnapshotManifest();
+    }
+    // 新表安装之后再清空memtable，期间的读者总能在两者之一中读到
+    s->reset();
+    policy->recordFlush(bytes);
+    return true;
 }
 
 /**
@@ -82,7 +524,25 @@ KVStore::~KVStore()
  * No return values for simplicity.
  */
 void KVStore::put(uint64_t key, const std::string &val) {
+    putEntry(key, val, val);
+}
+
+/**
+ * @brief 写入一个ttlMillis毫秒后过期的键值对
+ *
+ * 过期时刻编码在值内，过期后get/scan视为不存在，合并时丢弃（非最底层写成删除标记），
+ * 被丢弃的键和合并过滤器丢弃的键一样从HNSW索引和嵌入向量存储中删除
+ */
+void KVStore::put(uint64_t key, const std::string &val, uint64_t ttlMillis) {
+    putEntry(key, val, encodeTTL(val, nowMillis() + ttlMillis));
+}
+
+/**
+ * @brief put的实现：嵌入向量与HNSW索引按val维护，memtable中存放stored（val本身或其TTL编码）
+ */
+void KVStore::putEntry(uint64_t key, const std::string &val, const std::string &stored) {
     std::cout << "put key: " << key  << std::endl;
+    applyFilteredKey(key);
     // put操作的不同情况：
     if (val == DEL) {
         // 当前为删除操作
@@ -128,32 +588,115 @@ void KVStore::put(uint64_t key, const std::string &val) {
         }
     }
 
+    writeMemtable(key, stored);
+}
+
+/**
+ * @brief 把stored写入memtable，写满时先落盘并触发合并
+ */
+void KVStore::writeMemtable(uint64_t key, const std::string &stored) {
     uint32_t nxtsize = s->getBytes();
     std::string res  = s->search(key);
     if (!res.length()) { // new add
-        nxtsize += 12 + val.length();
+        nxtsize += 12 + stored.length();
     } else
-        nxtsize = nxtsize - res.length() + val.length(); // change string
-    if (nxtsize + 10240 + 32 <= MAXSIZE)
-        s->insert(key, val); // 小于等于（不超过） 2MB
+        nxtsize = nxtsize - res.length() + stored.length(); // change string
+    if (nxtsize + 10240 + 32 <= options.targetFileSize)
+        s->insert(key, stored); // 小于等于（不超过） targetFileSize
     else {
         // 持久化跳表时，把嵌入向量持久化
         save_embedding_to_disk();
+        // 后台合并跟不上时在这里减速或阻塞
+        throttleWrites();
 
-        sstable ss(s);
-        s->reset();
-        std::string url  = ss.getFilename();
-        std::string path = "./data/level-0";
-        if (!utils::dirExists(path)) {
-            utils::mkdir(path.data());
-            totalLevel = 0;
-        }
-        addsstable(ss, 0);      // 加入缓存
-        ss.putFile(url.data()); // 加入磁盘
+        flushMemtable();
         compaction();
-        s->insert(key, val);
+        s->insert(key, stored);
     }
+}
 
+/**
+ * @brief 读-改-写：把operand记为key的合并操作数，由KVStoreOptions::mergeOperator在读取和合并时折叠
+ *
+ * 不读sstable：memtable中已有基础值时直接折叠，已有操作数时两两合并，否则写入一条操作数记录。
+ * 合并得到的值不进入嵌入向量存储和HNSW索引
+ */
+void KVStore::merge(uint64_t key, const std::string &operand) {
+    if (!options.mergeOperator)
+        throw std::logic_error("merge requires KVStoreOptions::mergeOperator");
+    applyFilteredKey(key);
+    std::string cur = s->search(key), stored;
+    if (!cur.length()) {
+        stored = encodeMerge(operand);
+    } else if (isMergeRecord(cur)) {
+        std::string acc(mergeOperand(cur));
+        stored = encodeMerge(options.mergeOperator->merge(key, &acc, operand));
+    } else if (cur == DEL || isExpired(cur, nowMillis())) {
+        stored = options.mergeOperator->merge(key, nullptr, operand);
+    } else if (hasTTL(cur)) {
+        // 折叠后保留基础值的过期时刻
+        std::string base(ttlValue(cur));
+        stored = encodeTTL(options.mergeOperator->merge(key, &base, operand), ttlExpireAt(cur));
+    } else {
+        stored = options.mergeOperator->merge(key, &cur, operand);
+    }
+    writeMemtable(key, stored);
+}
+
+/**
+ * @brief 从memtable到最底层依次收集key的版本，直到遇到一个不是操作数的版本，再按从旧到新折叠
+ *
+ * 调用方需持有indexMutex的共享锁
+ */
+std::string KVStore::mergedValue(uint64_t key) {
+    if (!options.mergeOperator)
+        throw std::runtime_error("merge operand found but no mergeOperator is configured");
+    std::vector<std::string> operands; // 从新到旧
+    std::string base;
+    bool hasBase = false;
+    uint64_t now = nowMillis();
+    // 返回true表示已经找到基础值（删除标记和过期值视为不存在），不用再往下找
+    auto consume = [&](const std::string &value) {
+        if (isMergeRecord(value)) {
+            operands.emplace_back(mergeOperand(value));
+            return false;
+        }
+        if (value.length() && value != DEL && !isExpired(value, now)) {
+            base    = hasTTL(value) ? std::string(ttlValue(value)) : value;
+            hasBase = true;
+        }
+        return true;
+    };
+
+    std::string value = s->search(key);
+    bool found        = value.length() && consume(value);
+    bloomProbe probe(key);
+    for (int level = 0; level <= totalLevel && !found; ++level) {
+        // 同层内可能有多个表含有key（第0层或Tiered），按时间戳从新到旧
+        std::vector<std::pair<uint64_t, sstablehead *>> tables;
+        for (sstablehead &it : sstableIndex[level]) {
+            uint32_t len;
+            if (key >= it.getMinV() && key <= it.getMaxV() && it.searchOffset(probe, len) != -1)
+                tables.push_back({it.getTime(), &it});
+        }
+        std::sort(tables.begin(), tables.end(), [](auto &a, auto &b) { return a.first > b.first; });
+        for (auto &[time, head] : tables) {
+            uint32_t len;
+            int offset = head->searchOffset(probe, len);
+            if (consume(fetchString(head->getFilename(), offset + 32 + 10240 + 12 * head->getCnt(), len))) {
+                found = true;
+                break;
+            }
+        }
+    }
+
+    std::string res;
+    const std::string *cur = hasBase ? &base : nullptr;
+    for (auto it = operands.rbegin(); it != operands.rend(); ++it) {
+        res = options.mergeOperator->merge(key, cur, *it);
+        cur = &res;
+    }
+    return cur ? *cur : "";
 }
 
 /**
@@ -162,47 +705,114 @@ void KVStore::put(uint64_t key, const std::string &val) {
  */
 std::string KVStore::get(uint64_t key) //
 {
+    PinnableValue value;
+    if (!get(key, value))
+        return "";
+    return value.toString();
+}
+
+bool KVStore::get(uint64_t key, PinnableValue &value) {
     uint64_t time = 0;
     int goalOffset;
     uint32_t goalLen;
     std::string goalUrl;
+    value.reset();
     std::string res = s->search(key);
     if (res.length()) { // 在memtable中找到, 或者是deleted，说明最近被删除过，
                         // 不用查sstable
-        if (res == DEL)
-            return "";
-        return res;
+        if (isMergeRecord(res)) { // 合并操作数需要与更旧的版本折叠
+            std::shared_lock<std::shared_mutex> lock(indexMutex);
+            loadHeads(lock, key, key);
+            value.assign(mergedValue(key));
+            return !value.empty();
+        }
+        if (!liveValue(res, nowMillis()))
+            return false;
+        // memtable的节点会被原地覆盖，不能钉住
+        value.assign(std::move(res));
+        return true;
     }
-    for (int level = 0; level <= totalLevel; ++level) {
-        for (sstablehead it : sstableIndex[level]) {
-            if (key < it.getMinV() || key > it.getMaxV())
-                continue;
-            uint32_t len;
-            int offset = it.searchOffset(key, len);
-            if (offset == -1) {
-                if (!level)
+    std::shared_lock<std::shared_mutex> lock(indexMutex);
+    bool indexed = false;
+    if (hashIndex) {
+        // 一次探测得到键最新版本所在的表和下标，不用逐层查bloom和二分
+        int64_t slot = hashIndex->find(key, [&](uint32_t id, uint32_t pos) { return hashMatch(key, id, pos); });
+        if (slot >= 0) {
+            sstablehead *it = hashTables[hashIndex->fileOf(slot)];
+            int p           = hashIndex->posOf(slot);
+            goalUrl         = it->getFilename();
+            goalOffset      = it->getOffset(p - 1) + 32 + 10240 + 12 * it->getCnt();
+            goalLen         = it->getOffset(p) - it->getOffset(p - 1);
+            indexed         = true;
+        } else if (hashIndex->isComplete())
+            return false; // 所有表的键都在索引中
+    }
+    if (!indexed) {
+        loadHeads(lock, key, key);
+        bloomProbe probe(key); // key的哈希值只算一次，各表的bloom共用
+        for (int level = 0; level <= totalLevel; ++level) {
+            for (sstablehead &it : sstableIndex[level]) {
+                if (key < it.getMinV() || key > it.getMaxV())
                     continue;
-                else
-                    break;
-            }
-            // sstable ss;
-            // ss.loadFile(it.getFilename().data());
-            if (it.getTime() > time) { // find the latest head
-                time       = it.getTime();
-                goalUrl    = it.getFilename();
-                goalOffset = offset + 32 + 10240 + 12 * it.getCnt();
-                goalLen    = len;
+                uint32_t len;
+                int offset = it.searchOffset(probe, len);
+                if (offset == -1) {
+                    // 层内表可能重叠（第0层，或Tiered策略下的任意层）时要查完整层
+                    if (policy->levelOverlaps(level))
+                        continue;
+                    else
+                        break;
+                }
+                // sstable ss;
+                // ss.loadFile(it.getFilename().data());
+                if (it.getTime() > time) { // find the latest head
+                    time       = it.getTime();
+                    goalUrl    = it.getFilename();
+                    goalOffset = offset + 32 + 10240 + 12 * it.getCnt();
+                    goalLen    = len;
+                }
             }
+            if (time)
+                break; // only a test for found
         }
-        if (time)
-            break; // only a test for found
     }
     if (!goalUrl.length())
-        return ""; // not found a sstable
-    res = fetchString(goalUrl, goalOffset, goalLen);
-    if (res == DEL)
-        return "";
-    return res;
+        return false; // not found a sstable
+    std::shared_ptr<MappedFile> file = mapFile(goalUrl);
+    // 上报给限速器的只是读值本身的耗时：映射时为逐页访问值触发的缺页，否则为按偏移读文件
+    auto start = std::chrono::steady_clock::now();
+    std::string_view stored;
+    if (file && goalOffset + goalLen <= file->size()) {
+        stored = std::string_view(file->data() + goalOffset, goalLen);
+        if (options.rateLimiter) {
+            volatile char sink = 0;
+            for (size_t i = 0; i < stored.size(); i += 4096)
+                sink = sink ^ stored[i];
+            if (!stored.empty())
+                sink = sink ^ stored.back();
+        }
+    } else { // 不能映射时读出一份副本
+        res    = fetchString(goalUrl, goalOffset, goalLen);
+        stored = res;
+        file   = nullptr;
+    }
+    if (options.rateLimiter) {
+        // 上报前台读盘耗时，供限速器自动调节合并的速率
+        options.rateLimiter->recordReadLatency(std::chrono::duration_cast<std::chrono::microseconds>(
+                                                   std::chrono::steady_clock::now() - start)
+                                                   .count());
+    }
+    if (isMergeRecord(stored)) {
+        value.assign(mergedValue(key));
+        return !value.empty();
+    }
+    if (!liveValue(stored, nowMillis()))
+        return false;
+    if (file)
+        value.pinSlice(file, stored);
+    else
+        value.assign(std::string(stored));
+    return true;
 }
 
 /**
@@ -235,6 +845,13 @@ void KVStore::reset() {
     hnswIndex = new HNSWIndex();
 
     s->reset(); // 先清空memtable
+    waitForCompaction();
+    std::unique_lock<std::shared_mutex> lock(indexMutex);
+    {
+        std::lock_guard<std::mutex> mappedLock(mappedMutex);
+        mappedFiles.clear();
+        mappedLru.clear();
+    }
     std::vector<std::string> files;
     for (int level = 0; level <= totalLevel; ++level) { // 依层清空每一层的sstables
         std::string path = std::string("./data/level-") + std::to_string(level);
@@ -244,9 +861,17 @@ void KVStore::reset() {
             utils::rmfile(file.data());
         }
         utils::rmdir(path.data());
+        for (auto &head : sstableIndex[level])
+            head.dropCached();
         sstableIndex[level].clear();
     }
     totalLevel = -1;
+    writeManifestSnapshot();
+    if (hashIndex) {
+        hashIndex->clear();
+        hashTables.clear();
+    }
+    policy->reset();
 
 
 
@@ -282,22 +907,27 @@ void KVStore::reset_key_embedding_store() {
 struct myPair {
     uint64_t key, time;
     int id, index;
+    int level; // 来源层号，memtable为-1
     std::string filename;
 
     myPair(uint64_t key, uint64_t time, int index, int id,
-           std::string file) { // construct function
+           std::string file, int level = -1) { // construct function
         this->time     = time;
         this->key      = key;
         this->id       = id;
         this->index    = index;
         this->filename = file;
+        this->level    = level;
     }
 };
 
 struct cmp {
     bool operator()(myPair &a, myPair &b) {
-        if (a.key == b.key)
+        if (a.key == b.key) {
+            if (a.level != b.level)
+                return a.level > b.level; // 层号小的数据更新
             return a.time < b.time;
+        }
         return a.key > b.key;
     }
 };
@@ -315,28 +945,43 @@ struct cmp {
 void KVStore::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list) {
     // 创建向量存储从内存跳表中获取的键值对
     std::vector<std::pair<uint64_t, std::string>> mem;
+    // 从内存跳表中扫描指定范围的键值对
+    s->scan(key1, key2, mem);   // 将结果存入mem向量
+
+    std::vector<std::pair<uint64_t, std::string>> res;
+    std::shared_lock<std::shared_mutex> lock(indexMutex);
+    loadHeads(lock, key1, key2);
+    scanRange(key1, key2, mem, 0, mem.size(), res);
+    for (auto &it : res)
+        list.emplace_back(it.first, std::move(it.second));
+}
+
+/**
+ * @brief 对[key1, key2]内的SSTable与memtable片段mem[memBegin, memEnd)做多路归并，结果按键升序追加到res
+ *
+ * 只读访问sstableIndex，可以被多个线程同时调用（scan_parallel中每个子区间一个线程）
+ */
+void KVStore::scanRange(uint64_t key1, uint64_t key2, const std::vector<std::pair<uint64_t, std::string>> &mem,
+                        size_t memBegin, size_t memEnd, std::vector<std::pair<uint64_t, std::string>> &res) {
     // 创建优先级队列用于多路归并，使用myPair结构体和cmp比较器
     // 优先级队列按键值升序排列，键值相同时按时间戳降序（新的在前）
     std::priority_queue<myPair, std::vector<myPair>, cmp> heap;
-    // 存储参与查询的SSTable头信息
-    std::vector<sstablehead> sshs;
-    
-    // 从内存跳表中扫描指定范围的键值对
-    s->scan(key1, key2, mem);   // 将结果存入mem向量
-    
+    // 存储参与查询的SSTable头信息（指针，避免复制10KB的bloom）
+    std::vector<sstablehead *> sshs;
+
     // 记录每个SSTable在查询范围内的起始和结束索引
-    std::vector<int> head, end; // [head, end) 左闭右开区间
+    std::vector<int> end; // [head, end) 左闭右开区间
     int cnt = 0;  // SSTable计数器，用于给每个SSTable分配唯一ID
     
     // 如果内存中有数据，将第一个元素加入优先级队列
-    if (mem.size())
+    if (memBegin < memEnd)
         // 内存数据的时间戳设为INF（无穷大），确保优先级最高
         // id设为-1表示来自内存，filename设为占位符"qwq"，绷不住了qwq
-        heap.push(myPair(mem[0].first, INF, 0, -1, "qwq"));
+        heap.push(myPair(mem[memBegin].first, INF, memBegin, -1, "qwq"));
     
     // 遍历所有层级的SSTable，寻找与查询范围有交集的表
     for (int level = 0; level <= totalLevel; ++level) {
-        for (sstablehead it : sstableIndex[level]) {
+        for (sstablehead &it : sstableIndex[level]) {
             // 检查SSTable的键值范围是否与查询范围有交集
             // 如果key1大于表的最大值，或key2小于表的最小值，则无交集
             if (key1 > it.getMaxV() || key2 < it.getMinV())
@@ -346,28 +991,24 @@ void KVStore::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, s
             int hIndex = it.lowerBound(key1); // headIndex
             // 使用二分查找找到key2在该SSTable中的位置
             int tIndex = it.lowerBound(key2); // tailIndex
-            
-            if (hIndex < it.getCnt()) { // 如果该SSTable中确实有可用数据
-                // 获取SSTable的文件路径
-                std::string url = it.getFilename();
+            // 调整结束索引：如果key2确实在表中，则包含它
+            if (tIndex < it.getCnt() && it.getKey(tIndex) == key2)
+                tIndex++; // tIndex变为第一个不包含的位置
+
+            if (hIndex < tIndex) { // 如果该SSTable中确实有落在范围内的数据
                 // 将该SSTable的第一个有效键加入优先级队列
-                heap.push(myPair(it.getKey(hIndex), it.getTime(), hIndex, cnt++, url));
-                // 记录该SSTable的查询起始索引
-                head.push_back(hIndex);
-                
-                // 调整结束索引：如果key2确实在表中，则包含它
-                if (it.search(key2) == tIndex)
-                    tIndex++; // tIndex变为第一个不包含的位置
+                heap.push(myPair(it.getKey(hIndex), it.getTime(), hIndex, cnt++, it.getFilename(), level));
                 // 记录该SSTable的查询结束索引
                 end.push_back(tIndex);
                 // 保存SSTable头信息用于后续数据读取
-                sshs.push_back(it);
+                sshs.push_back(&it);
             }
         }
     }
     
     // 用于去重：记录上一个处理的键值，确保相同键只选择时间戳最新的版本
     uint64_t lastKey = INF; // 初始化为无穷大，确保第一个键肯定不等于它
+    uint64_t now     = nowMillis(); // 整次扫描用同一时刻判断过期
     
     // 多路归并的主循环，直到优先级队列为空
     while (!heap.empty()) { // 维护堆进行多路归并
@@ -381,39 +1022,43 @@ void KVStore::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, s
                 
                 // 计算数据在文件中的位置和长度
                 // getOffset(cur.index-1)获取前一个条目的结束位置
-                uint32_t start = sshs[cur.id].getOffset(cur.index - 1);
+                uint32_t start = sshs[cur.id]->getOffset(cur.index - 1);
                 // 当前条目的结束位置减去开始位置得到数据长度
-                uint32_t len = sshs[cur.id].getOffset(cur.index) - start;
+                uint32_t len = sshs[cur.id]->getOffset(cur.index) - start;
                 // 获取SSTable中的条目总数
-                uint32_t scnt = sshs[cur.id].getCnt();
+                uint32_t scnt = sshs[cur.id]->getCnt();
                 
                 // 从文件中读取实际的值数据
                 // 文件布局：10240字节Bloom Filter + 32字节头 + scnt*12字节索引 + 数据区
-                std::string res = fetchString(cur.filename, 10240 + 32 + scnt * 12 + start, len);
+                std::string value = fetchString(cur.filename, 10240 + 32 + scnt * 12 + start, len);
                 
-                // 如果数据有效且不是删除标记，则加入结果列表
-                if (res.length() && res != DEL)
-                    list.emplace_back(cur.key, res);
+                if (isMergeRecord(value))
+                    value = mergedValue(cur.key);
+                // 如果数据有效且不是删除标记、未过期，则加入结果列表
+                if (liveValue(value, now))
+                    res.emplace_back(cur.key, std::move(value));
             }
             
             // 如果该SSTable还有下一个条目在查询范围内，则加入优先级队列
             if (cur.index + 1 < end[cur.id]) { // 检查是否超出查询范围
                 // 创建下一个条目并加入堆
-                heap.push(myPair(sshs[cur.id].getKey(cur.index + 1), cur.time, cur.index + 1, cur.id, cur.filename));
+                heap.push(myPair(sshs[cur.id]->getKey(cur.index + 1), cur.time, cur.index + 1, cur.id, cur.filename, cur.level));
             }
         } else { // 当前条目来自内存（id == -1）
             if (cur.key != lastKey) { // 如果是新的键值
                 lastKey = cur.key;   // 更新最后处理的键值
                 // 直接从内存数组中获取值
-                std::string res = mem[cur.index].second;
+                std::string value = mem[cur.index].second;
                 
-                // 如果数据有效且不是删除标记，则加入结果列表
-                if (res.length() && res != DEL)
-                    list.emplace_back(cur.key, mem[cur.index].second);
+                if (isMergeRecord(value))
+                    value = mergedValue(cur.key);
+                // 如果数据有效且不是删除标记、未过期，则加入结果列表
+                if (liveValue(value, now))
+                    res.emplace_back(cur.key, std::move(value));
             }
             
             // 如果内存中还有下一个条目，则加入优先级队列
-            if (cur.index < mem.size() - 1) {
+            if (cur.index + 1 < memEnd) {
                 // 创建下一个内存条目并加入堆
                 heap.push(myPair(mem[cur.index + 1].first, cur.time, cur.index + 1, -1, cur.filename));
             }
@@ -421,208 +1066,822 @@ void KVStore::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, s
     }
 }
 
+void KVStore::scan_parallel(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list) {
+    scan_parallel(key1, key2, [&list](std::vector<std::pair<uint64_t, std::string>> &chunk) {
+        for (auto &it : chunk)
+            list.emplace_back(it.first, std::move(it.second));
+    });
+}
+
+/**
+ * @brief 并行范围查询：用SSTable的围栏键(fence key)把[key1, key2]切成若干互不相交的子区间，
+ * 每个子区间在线程池中独立做多路归并，再按区间顺序把结果块交给callback
+ * @param callback 按键升序依次收到每个子区间的结果块，可以边归并边消费（流式导出）
+ */
+void KVStore::scan_parallel(uint64_t key1, uint64_t key2, const ScanCallback &callback) {
+    if (key1 > key2)
+        return;
+    const int NUM_THREADS = std::max(1u, std::thread::hardware_concurrency());
+
+    // memtable只在调用线程上扫描一次，各子区间共享这份有序快照
+    std::vector<std::pair<uint64_t, std::string>> mem;
+    s->scan(key1, key2, mem);
+
+    // 整个并行归并期间持有读锁，保证各子区间看到同一组SSTable
+    std::shared_lock<std::shared_mutex> lock(indexMutex);
+    loadHeads(lock, key1, key2);
+
+    // 收集围栏键：每个相交SSTable的最小键，以及大表内部按步长采样的索引键
+    std::vector<uint64_t> fences;
+    for (int level = 0; level <= totalLevel; ++level) {
+        for (sstablehead &it : sstableIndex[level]) {
+            if (key1 > it.getMaxV() || key2 < it.getMinV())
+                continue;
+            if (it.getMinV() > key1)
+                fences.push_back(it.getMinV());
+            int hIndex = it.lowerBound(key1);
+            int tIndex = it.lowerBound(key2);
+            int step   = std::max(1, (tIndex - hIndex) / NUM_THREADS);
+            for (int p = hIndex + step; p < tIndex; p += step)
+                fences.push_back(it.getKey(p));
+        }
+    }
+    std::sort(fences.begin(), fences.end());
+    fences.erase(std::unique(fences.begin(), fences.end()), fences.end());
+
+    // 在围栏键中按分位数选出至多NUM_THREADS - 1个切分点，子区间为[bounds[i], bounds[i + 1] - 1]
+    std::vector<uint64_t> bounds{key1};
+    int parts = std::min<int>(NUM_THREADS, fences.size() + 1);
+    for (int i = 1; i < parts; ++i) {
+        uint64_t b = fences[(size_t)i * fences.size() / parts];
+        if (b > bounds.back() && b <= key2)
+            bounds.push_back(b);
+    }
+
+    auto runPart = [&](size_t i) {
+        uint64_t lo = bounds[i], hi = (i + 1 < bounds.size()) ? bounds[i + 1] - 1 : key2;
+        size_t memBegin = std::lower_bound(mem.begin(), mem.end(), std::make_pair(lo, std::string())) - mem.begin();
+        size_t memEnd   = std::upper_bound(
+                            mem.begin(),
+                            mem.end(),
+                            hi,
+                            [](uint64_t k, const std::pair<uint64_t, std::string> &p) { return k < p.first; }
+                        ) -
+                        mem.begin();
+        std::vector<std::pair<uint64_t, std::string>> chunk;
+        scanRange(lo, hi, mem, memBegin, memEnd, chunk);
+        return chunk;
+    };
+
+    if (bounds.size() == 1) { // 范围太小，没有可切分的围栏键，直接在当前线程归并
+        auto chunk = runPart(0);
+        callback(chunk);
+        return;
+    }
+
+    ThreadPool pool(std::min<size_t>(NUM_THREADS, bounds.size()));
+    std::vector<std::future<std::vector<std::pair<uint64_t, std::string>>>> futures;
+    for (size_t i = 0; i < bounds.size(); ++i)
+        futures.push_back(pool.enqueue(runPart, i));
+    // 按区间顺序取结果，前面的块一完成就交给调用方
+    for (auto &fut : futures) {
+        auto chunk = fut.get();
+        callback(chunk);
+    }
+}
+
 /**
  * @brief LSM-Tree的层级压缩合并函数，将当前层的SSTable合并到下一层
  * @param level 要进行压缩的层级，默认从第0层开始
+ *
+ * 同步模式下在调用线程上逐层向下合并，直到没有层超过阈值；
+ * 后台模式（options.backgroundCompaction）下只提交后台任务，立即返回
  */
 void KVStore::compaction(int level) {
-    // 检查第0层的文件数量是否超过阈值（2个）
-    // 如果第0层文件数量不超过2个，则不需要进行合并操作
-    if (level == 0 && sstableIndex[0].size() <= 2) return;
+    if (compactionPool) {
+        maybeScheduleCompaction();
+        return;
+    }
+    // 每次合并后检查下一层是否也需要合并，确保LSM-Tree的层级结构始终保持平衡；
+    // 最底层是否原地合并由策略决定（分层策略的最底层分数为0）
+    while (level < (int)sstableIndex.size() && needsCompaction(level)) {
+        compactOnce(level);
+        level++;
+    }
+}
 
-    // 构造下一层的目录路径字符串
-    // 例如：当前层为0时，下一层路径为"./data/level-1"
-    std::string targetLevelPath = "./data/level-" + std::to_string(level + 1);
-    
-    // 检查下一层目录是否存在，如果不存在则创建该目录
-    if (!utils::dirExists(targetLevelPath)) {
-        // 创建下一层目录
-        utils::mkdir(targetLevelPath.c_str());
-        // 更新总层数，确保totalLevel至少为level+1
-        if (totalLevel < level + 1) totalLevel = level + 1;
+/**
+ * @brief 把与[key1, key2]重叠的数据逐层推到最底层，途中丢弃旧版本，在最底层丢弃删除标记
+ *
+ * 先把memtable落盘，再占住合并调度（等待并阻止后台合并），从第0层开始每层做一次合并。
+ * 各层逐层串行处理：上一层的输出是下一层合并的输入，不同层之间不并行；并行只发生在一层之内，
+ * 每次合并按输入表边界切成至多max(maxSubcompactions, CPU核数)片并行归并。
+ * 最后原地重写最底层中范围内含删除标记的表。
+ * 设置了合并过滤器时不做平凡移动，最底层范围内的表也全部重写，范围内每个键都经过一次过滤器
+ */
+void KVStore::compactRange(uint64_t key1, uint64_t key2) {
+    // 与writeMemtable相同，落盘之前先保存嵌入向量，磁盘上的嵌入向量不落后于已落盘的表
+    save_embedding_to_disk();
+    flushMemtable();
+    {
+        std::unique_lock<std::mutex> lock(compactionMutex);
+        compactionCv.wait(lock, [this] { return !compactionScheduled; });
+        compactionScheduled = true;
+    }
+    {
+        // compactOnce可能抛出异常，离开时总要释放合并调度，否则之后的合并和被反压的写入会永远等待
+        struct ScheduleGuard {
+            KVStore *store;
+            ~ScheduleGuard() {
+                {
+                    std::lock_guard<std::mutex> lock(store->compactionMutex);
+                    store->compactionScheduled = false;
+                }
+                store->compactionCv.notify_all();
+            }
+        } guard{this};
+        int bottom;
+        {
+            std::shared_lock<std::shared_mutex> lock(indexMutex);
+            bottom = std::min(std::max(totalLevel, 1), (int)sstableIndex.size() - 1);
+        }
+        for (int level = 0; level < bottom; ++level)
+            compactOnce(level, level + 1, key1, key2);
+        compactOnce(bottom, bottom, key1, key2);
+    }
+    // 最底层可能因此超过目标大小，交给常规合并处理
+    compaction();
+}
+
+/**
+ * @brief 合并整棵树，等价于compactRange(0, INF)
+ */
+void KVStore::compactAll() {
+    compactRange(0, INF);
+}
+
+/**
+ * @brief 判断某层是否需要合并
+ */
+bool KVStore::needsCompaction(int level) {
+    return compactionScore(level) >= 1;
+}
+
+/**
+ * @brief 某层的合并分数，由合并策略给出，分数越高越紧迫
+ */
+double KVStore::compactionScore(int level) {
+    if (level > totalLevel)
+        return 0;
+    return policy->score(sstableIndex.data(), sstableIndex.size(), level);
+}
+
+/**
+ * @brief 选出合并分数最高且不小于1的层，没有需要合并的层时返回-1
+ */
+int KVStore::pickCompactionLevel() {
+    std::shared_lock<std::shared_mutex> lock(indexMutex);
+    int best         = -1;
+    double bestScore = 1;
+    for (int level = 0; level <= totalLevel; ++level) {
+        double score = compactionScore(level);
+        if (score >= bestScore) {
+            best      = level;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief 估算尚待合并的字节数，调用方需持有indexMutex
+ */
+uint64_t KVStore::pendingCompactionBytes() {
+    return policy->pendingBytes(sstableIndex.data(), sstableIndex.size());
+}
+
+/**
+ * @brief 有层需要合并且后台没有合并循环在跑时，向compactionPool提交一个合并循环
+ */
+void KVStore::maybeScheduleCompaction() {
+    std::lock_guard<std::mutex> lock(compactionMutex);
+    if (compactionScheduled || pickCompactionLevel() < 0)
+        return;
+    compactionScheduled = true;
+    compactionPool->enqueue([this] { backgroundCompaction(); });
+}
+
+/**
+ * @brief 后台合并循环：每轮挑分数最高的层合并一次，完成后通知被反压的写入
+ */
+void KVStore::backgroundCompaction() {
+    while (true) {
+        {
+            // 判断与清除compactionScheduled在同一临界区内，避免与flush后的调度检查竞争
+            std::lock_guard<std::mutex> lock(compactionMutex);
+            if (pickCompactionLevel() < 0) {
+                compactionScheduled = false;
+                break;
+            }
+        }
+        int level = pickCompactionLevel();
+        try {
+            if (level >= 0)
+                compactOnce(level);
+        } catch (const std::exception &e) {
+            // 线程池丢弃任务的异常：停止本轮合并并释放调度，下次flush后再重试
+            std::cout << "compaction fail: " << e.what() << std::endl;
+            {
+                std::lock_guard<std::mutex> lock(compactionMutex);
+                compactionScheduled = false;
+            }
+            break;
+        }
+        compactionCv.notify_all();
+    }
+    compactionCv.notify_all();
+}
+
+void KVStore::waitForCompaction() {
+    std::unique_lock<std::mutex> lock(compactionMutex);
+    compactionCv.wait(lock, [this] { return !compactionScheduled; });
+}
+
+/**
+ * @brief 第0层的有效文件数：分区时一次flush产生多个互不重叠的表，按重叠深度计，否则按文件数
+ */
+int KVStore::level0Runs() {
+    if (options.level0Partitions > 1 && !policy->levelOverlaps(1))
+        return overlapDepth(sstableIndex[0]);
+    return sstableIndex[0].size();
+}
+
+/**
+ * @brief 写入反压：第0层文件数或待合并字节数超过停写阈值时阻塞flush，超过减速阈值时休眠一小段
+ * 只在后台合并模式下生效，同步模式下合并本来就在写线程上完成
+ */
+void KVStore::throttleWrites() {
+    if (!compactionPool)
+        return;
+    auto overStop = [this] {
+        std::shared_lock<std::shared_mutex> lock(indexMutex);
+        return level0Runs() >= options.level0StopTrigger ||
+               pendingCompactionBytes() >= options.pendingCompactionBytesStop;
+    };
+    if (overStop()) {
+        maybeScheduleCompaction();
+        std::unique_lock<std::mutex> lock(compactionMutex);
+        compactionCv.wait(lock, [&] { return !overStop() || !compactionScheduled; });
     }
+    bool overSlowdown;
+    {
+        std::shared_lock<std::shared_mutex> lock(indexMutex);
+        overSlowdown = level0Runs() >= options.level0SlowdownTrigger ||
+                       pendingCompactionBytes() >= options.pendingCompactionBytesSlowdown;
+    }
+    if (overSlowdown)
+        std::this_thread::sleep_for(std::chrono::microseconds(options.slowdownMicros));
+}
 
-    // 创建一个向量来存储要参与合并的SSTable头信息
+/**
+ * @brief 执行一次level层到level+1层的合并，不向下递归
+ *
+ * @param manualOutputLevel 小于0时由合并策略选表；否则为手动合并的输出层（level+1，或level本身表示原地重写），
+ * 选出level层与[key1, key2]重叠的表
+ *
+ * 选表与安装结果时持有独占锁，中间的多路归并不持锁：同一时刻只有一个合并在进行，
+ * 输入表只会被本次合并删除，读者看到的始终是合并前或合并后的完整状态
+ */
+void KVStore::compactOnce(int level, int manualOutputLevel, uint64_t key1, uint64_t key2) {
+    // 创建一个向量来存储要参与合并的SSTable头信息，以及每个表所在的层
     std::vector<sstablehead> selectedTables;
+    std::vector<int> selectedLevels;
     // 初始化键值范围的最小值为无穷大（用于后续比较求最小值）
     uint64_t minKey = INF;
     // 初始化键值范围的最大值为0（用于后续比较求最大值）
     uint64_t maxKey = 0;
-
-    // 根据不同层级采用不同的合并策略
-    if (level == 0) {
-        // 第0层策略：全部文件参与合并
-        // 原因：第0层的SSTable可能有重叠的键值范围，需要全部合并
-        for (int i = 0; i < sstableIndex[0].size(); i++) {
-            // 将当前SSTable头信息添加到待合并列表
-            selectedTables.push_back(sstableIndex[0][i]);
-            // 更新整体键值范围的最小值
-            minKey = std::min(minKey, sstableIndex[0][i].getMinV());
-            // 更新整体键值范围的最大值
-            maxKey = std::max(maxKey, sstableIndex[0][i].getMaxV());
+    // 判断输出层是否为最底层，这决定了是否可以丢弃删除标记
+    bool isDeepestLevel;
+    // 输出层的下一层每个表的(最大键, 字节数)，按键有序，用于切分输出表
+    std::vector<std::pair<uint64_t, uint64_t>> grandparents;
+    // 输出层及其目录，例如：当前层为0时，下一层路径为"./data/level-1"
+    int outputLevel;
+    std::string targetLevelPath;
+    CompactionJob job;
+
+    {
+        std::unique_lock<std::shared_mutex> lock(indexMutex);
+
+        if (manualOutputLevel < 0) {
+            // 由合并策略挑选本层的输入表
+            if (!policy->pick(sstableIndex.data(), sstableIndex.size(), level, job)) return;
+        } else {
+            // 手动合并：选出本层与[key1, key2]重叠的表，层内可能重叠时取整层，避免旧版本留在上层。
+            // 输出层就是本层（最底层）时原地重写其中含删除标记的表
+            job.level            = level;
+            job.outputLevel      = manualOutputLevel;
+            job.mergeOutputLevel = job.outputLevel != level;
+            bool wholeLevel      = policy->levelOverlaps(level);
+            for (int i = 0; i < (int)sstableIndex[level].size(); i++) {
+                sstablehead &sshead = sstableIndex[level][i];
+                if (!wholeLevel && (key2 < sshead.getMinV() || key1 > sshead.getMaxV()))
+                    continue;
+                if (!wholeLevel && !job.mergeOutputLevel && !sshead.getDelCnt() && !options.compactionFilter)
+                    continue;
+                job.inputs.push_back(i);
+            }
         }
-    } else {
-        // 其他层策略：最多选择4个文件进行合并
-        // 计算实际要合并的文件数量（不超过4个，也不超过该层的总文件数）
-        int filesToMerge = std::min(4, (int)sstableIndex[level].size());
-        for (int i = 0; i < filesToMerge; i++) {
+        outputLevel     = job.outputLevel;
+        targetLevelPath = "./data/level-" + std::to_string(outputLevel);
+        // 检查输出层目录是否存在，如果不存在则创建该目录
+        if (!utils::dirExists(targetLevelPath)) {
+            // 创建输出层目录
+            utils::mkdir(targetLevelPath.c_str());
+        }
+        // 更新总层数，确保totalLevel至少为输出层
+        if (totalLevel < outputLevel) totalLevel = outputLevel;
+
+        for (int i : job.inputs) {
+            // 归并要用到索引，在复制表头之前读入
+            sstableIndex[level][i].ensureLoaded();
             // 将当前SSTable头信息添加到待合并列表
             selectedTables.push_back(sstableIndex[level][i]);
+            selectedLevels.push_back(level);
             // 更新整体键值范围的最小值
             minKey = std::min(minKey, sstableIndex[level][i].getMinV());
             // 更新整体键值范围的最大值
             maxKey = std::max(maxKey, sstableIndex[level][i].getMaxV());
         }
-    }
 
-    // 错误检查：如果没有选中任何SSTable，则直接返回
-    if (selectedTables.empty()) return;
+        // 错误检查：如果没有选中任何SSTable，则直接返回
+        if (selectedTables.empty()) return;
 
-    // 在下一层寻找与当前合并范围有重叠的SSTable，也要参与合并
-    // 这是LSM-Tree合并的重要特性：避免键值范围重叠
-    if (level + 1 <= totalLevel) {
-        // 遍历下一层的所有SSTable头信息
-        for (auto &sshead : sstableIndex[level + 1]) {
+        // 分层策略下，在下一层寻找与当前合并范围有重叠的SSTable，也要参与合并
+        // 这是LSM-Tree合并的重要特性：避免键值范围重叠
+        // 分级策略下新段直接放入下一层，不重写下一层已有的段
+        for (auto &sshead : sstableIndex[outputLevel]) {
+            if (!job.mergeOutputLevel)
+                break;
             // 检查键值范围是否有重叠
             // 重叠条件：!(maxKey < sshead.getMinV() || minKey > sshead.getMaxV())
             // 即：不满足(完全小于 或 完全大于)，则说明有重叠
             if (!(maxKey < sshead.getMinV() || minKey > sshead.getMaxV())) {
                 // 有重叠，将该SSTable也加入合并列表
+                sshead.ensureLoaded();
                 selectedTables.push_back(sshead);
+                selectedLevels.push_back(outputLevel);
             }
         }
+        // 输出层是最底层，且输出层中没有未参与合并的重叠段时，才能丢弃删除标记；原地重写时输入已含整层的重叠段
+        isDeepestLevel = (outputLevel == totalLevel) &&
+                         (job.mergeOutputLevel || outputLevel == level || sstableIndex[outputLevel].empty());
+
+        // 平凡移动(trivial move)：输入表与下一层、彼此之间都不重叠时，归并不会改变任何数据，
+        // 直接把文件移到下一层目录并更新表头中的文件名，不读写数据
+        // 手动合并且设置了合并过滤器时，所有数据都要经过过滤器
+        bool filterAll = manualOutputLevel >= 0 && options.compactionFilter;
+        if (job.mergeOutputLevel && !filterAll && trivialMove(level, selectedTables, selectedLevels, isDeepestLevel)) {
+            policy->installed(job);
+            return;
+        }
+
+        if (job.mergeOutputLevel && options.maxGrandparentOverlapBytes && outputLevel + 1 < (int)sstableIndex.size()) {
+            for (auto &sshead : sstableIndex[outputLevel + 1])
+                grandparents.push_back({sshead.getMaxV(), sshead.getBytes()});
+            std::sort(grandparents.begin(), grandparents.end());
+        }
     }
 
-    // 创建优先级队列用于多路合并，使用poi结构体和cmpPoi比较器
-    // poi结构体包含：sstableId(SSTable编号), pos(位置), time(时间戳), index(索引)
-    std::priority_queue<poi, std::vector<poi>, cmpPoi> pq;
-    // 创建向量存储所有要合并的SSTable对象（完整数据）
-    std::vector<sstable> tables(selectedTables.size());
+    // 归并要顺序读输入表的全部索引，分区模式下在私有副本中一次读入，不经过也不冲刷元数据缓存
+    for (auto &table : selectedTables)
+        table.makeResident();
 
-    // 将所有待合并的SSTable从磁盘加载到内存中
+    // 子合并(subcompaction)：用输入表的边界键把[minKey, maxKey]切成若干互不相交的切片，
+    // 每个切片在自己的线程上归并并产出自己的输出表
+    // 下一层参与合并的表可能超出本层的键范围，切片要覆盖所有输入表
+    for (auto &table : selectedTables) {
+        minKey = std::min(minKey, table.getMinV());
+        maxKey = std::max(maxKey, table.getMaxV());
+    }
+    std::vector<uint64_t> fences;
+    // 第0层分区时只在重叠组之间切：各组连同与它重叠的第1层表互不相交，每组在自己的线程上归并，
+    // 每个输入表只被一个切片读
+    bool partitioned = level == 0 && options.level0Partitions > 1 && !policy->levelOverlaps(outputLevel);
+    if (partitioned) {
+        std::vector<std::vector<int>> groups = overlapGroups(selectedTables);
+        for (size_t i = 1; i < groups.size(); ++i)
+            fences.push_back(selectedTables[groups[i][0]].getMinV());
+    } else {
+        for (auto &table : selectedTables) {
+            if (table.getMinV() > minKey)
+                fences.push_back(table.getMinV());
+            if (table.getMaxV() < maxKey)
+                fences.push_back(table.getMaxV() + 1);
+        }
+    }
+    std::sort(fences.begin(), fences.end());
+    fences.erase(std::unique(fences.begin(), fences.end()), fences.end());
+
+    std::vector<uint64_t> bounds{minKey}; // 切片i为[bounds[i], bounds[i + 1] - 1]
+    // 手动合并由调用方同步等待，切片数至少用满所有核
+    int maxSlices = options.maxSubcompactions;
+    if (manualOutputLevel >= 0)
+        maxSlices = std::max<int>(maxSlices, std::thread::hardware_concurrency());
+    if (partitioned)
+        maxSlices = std::max(maxSlices, options.level0Partitions);
+    int slices = std::min<int>(std::max(1, maxSlices), fences.size() + 1);
+    for (int i = 1; i < slices; ++i) {
+        uint64_t b = fences[(size_t)i * fences.size() / slices];
+        if (b > bounds.back())
+            bounds.push_back(b);
+    }
+
+    // 合并产生的新SSTable先写盘，最后在锁内一次性安装
+    std::vector<std::vector<sstablehead>> sliceOutputs(bounds.size());
+    auto runSlice = [&](size_t i) {
+        uint64_t lo = bounds[i], hi = (i + 1 < bounds.size()) ? bounds[i + 1] - 1 : maxKey;
+        mergeRange(selectedTables, selectedLevels, lo, hi, outputLevel, isDeepestLevel, grandparents,
+                   sliceOutputs[i]);
+    };
+    if (bounds.size() == 1) {
+        runSlice(0);
+    } else {
+        ThreadPool pool(bounds.size());
+        std::vector<std::future<void>> futures;
+        for (size_t i = 0; i < bounds.size(); ++i)
+            futures.push_back(pool.enqueue(runSlice, i));
+        for (auto &fut : futures)
+            fut.get();
+    }
+    std::vector<sstablehead> outputs;
+    for (auto &slice : sliceOutputs)
+        outputs.insert(outputs.end(), slice.begin(), slice.end());
+
+    uint64_t readBytes = 0, writeBytes = 0;
+    for (auto &head : selectedTables)
+        readBytes += head.getBytes();
+    for (auto &head : outputs)
+        writeBytes += head.getBytes();
+    policy->recordCompaction(readBytes, writeBytes);
+
+    // 原子地安装合并结果：加入新表，删除所有参与合并的原始SSTable文件
+    // 输出表已落盘；先把修改记入清单并落盘，之后崩溃时重新打开会删掉残留的输入文件。
+    // 清单写失败时抛出，输入表仍在索引和磁盘上，输出成为清单之外的文件
+    std::unique_lock<std::shared_mutex> lock(indexMutex);
+    VersionEdit edit;
+    for (auto &head : outputs)
+        edit.added.push_back(tableMeta(outputLevel, head));
+    for (auto &head : selectedTables)
+        edit.deleted.push_back(head.getFilename());
+    logEdit(edit);
+    if (hashIndex)
+        hashIndexReplace(selectedTables, outputs);
+    for (auto &head : outputs) {
+        if (options.metadataCache)
+            head.partition(options.metadataCache.get());
+        sstableIndex[outputLevel].push_back(head);
+    }
     for (size_t i = 0; i < selectedTables.size(); i++) {
-        // 根据文件名从磁盘加载完整的SSTable数据到内存
-        tables[i].loadFile(selectedTables[i].getFilename().c_str());
+        delsstable(selectedTables[i].getFilename());
+    }
+    policy->installed(job);
+    allocateFilters();
+    if (hashIndex) {
+        if (hashIndex->needsRebuild())
+            rebuildHashIndex();
+        else
+            refreshHashTables();
+    }
+    maybeSnapshotManifest();
+}
+
+
+
+/**
+ * @brief 尝试把inputs原样移到level+1层，调用方需持有indexMutex的独占锁
+ * @param dropDeletes 目标层是否为最底层；是则含删除标记的表仍走归并，以便回收删除标记
+ * @return 是否已经移动；返回false时未做任何修改，调用方继续正常合并
+ */
+bool KVStore::trivialMove(int level, std::vector<sstablehead> &inputs, const std::vector<int> &levels,
+                          bool dropDeletes) {
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        // 有下一层的表参与，说明与下一层重叠
+        if (levels[i] != level)
+            return false;
+        if (dropDeletes && inputs[i].getDelCnt())
+            return false;
+        ranges.push_back({inputs[i].getMinV(), inputs[i].getMaxV()});
+    }
+    // 第0层的表之间可能互相重叠，移到下一层后会破坏层内有序
+    std::sort(ranges.begin(), ranges.end());
+    for (size_t i = 1; i < ranges.size(); ++i) {
+        if (ranges[i].first <= ranges[i - 1].second)
+            return false;
+    }
 
-        // 如果SSTable不为空，将其第一个条目加入优先级队列
-        if (tables[i].getCnt() > 0) {
-            poi entry;                                    // 创建优先级队列条目
-            entry.sstableId = i;                         // 记录是第i个SSTable
-            entry.pos = 0;                               // 记录是该SSTable的第0个条目
-            entry.time = tables[i].getTime();            // 记录时间戳用于版本控制
-            entry.index = tables[i].getIndexById(0);     // 获取第0个索引条目（包含key等信息）
-            pq.push(entry);                              // 加入优先级队列
+    // 先在下一层建硬链接，清单提交后再删除原文件；任一步崩溃，重新打开时都会删掉清单之外的那一个
+    std::string targetLevelPath = "./data/level-" + std::to_string(level + 1);
+    std::vector<std::string> links;
+    for (auto &head : inputs) {
+        std::string from = head.getFilename();
+        std::string to   = targetLevelPath + from.substr(from.find_last_of('/'));
+        if (utils::lnfile(from.data(), to.data()) != 0) {
+            std::cout << "link fail!" << std::endl;
+            std::cout << strerror(errno) << std::endl;
+            for (auto &link : links)
+                utils::rmfile(link.data());
+            return false;
         }
+        links.push_back(to);
+    }
+    VersionEdit edit;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        edit.deleted.push_back(inputs[i].getFilename());
+        inputs[i].setFilename(links[i]);
+        edit.added.push_back(tableMeta(level + 1, inputs[i]));
+    }
+    try {
+        logEdit(edit);
+    } catch (...) {
+        for (auto &link : links)
+            utils::rmfile(link.data());
+        throw;
+    }
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        // 从原层摘除，再以新文件名加入下一层
+        std::vector<sstablehead> &cur = sstableIndex[level];
+        for (size_t j = 0; j < cur.size(); ++j) {
+            if (cur[j].getFilename() == edit.deleted[i]) {
+                cur.erase(cur.begin() + j);
+                break;
+            }
+        }
+        sstableIndex[level + 1].push_back(inputs[i]);
+    }
+    for (auto &head : edit.deleted) {
+        unmapFile(head);
+        utils::rmfile(head.data());
+    }
+    allocateFilters();
+    if (hashIndex) // 表的时间戳不变，编号和槽都不用改
+        refreshHashTables();
+    maybeSnapshotManifest();
+    return true;
+}
+
+/**
+ * @brief 对inputs中键落在[lo, hi]内的条目做多路归并，输出到outputLevel层的新SSTable
+ * @param levels 每个输入表所在的层，键相同时层号小的版本更新
+ * @param dropDeletes 输出层是否为最底层，是则丢弃删除标记
+ * @param grandparents level+2层各表的(最大键, 字节数)，输出表覆盖的这些表超过maxGrandparentOverlapBytes时切表
+ * @param outputs 已写盘的输出表头，由调用方统一安装
+ *
+ * 每个输入表一个流式读取器，按大块顺序读数据区，经败者树归并后写入增量构建的输出表。
+ * 内存占用约为 输入表数 * compactionReadaheadBytes + compactionWriteBufferBytes + 输出表的索引，与输入总大小无关。
+ * 不访问sstableIndex，多个切片可以并行调用
+ */
+void KVStore::mergeRange(std::vector<sstablehead> &inputs, const std::vector<int> &levels, uint64_t lo, uint64_t hi,
+                         int outputLevel, bool dropDeletes,
+                         const std::vector<std::pair<uint64_t, uint64_t>> &grandparents,
+                         std::vector<sstablehead> &outputs) {
+    std::string targetLevelPath = "./data/level-" + std::to_string(outputLevel);
+    CompactionFilter *filter    = options.compactionFilter.get();
+    std::vector<uint64_t> removed; // 过期或被过滤器丢弃的键
+    uint64_t now = nowMillis();
+    // 为每个输入表建立本切片范围内的读取器
+    std::vector<std::unique_ptr<sstablereader>> readers;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        int head = inputs[i].lowerBound(lo);
+        int end  = (hi == INF) ? inputs[i].getCnt() : inputs[i].lowerBound(hi + 1);
+        readers.push_back(std::make_unique<sstablereader>(&inputs[i], head, end, options.compactionReadaheadBytes,
+                                                          options.rateLimiter.get()));
     }
 
+    // 败者树的比较：键小的先出；键相同时层号小的版本更新，同层时间戳大的更新；已耗尽的排最后
+    auto before = [&](int a, int b) {
+        if (!readers[a]->valid())
+            return false;
+        if (!readers[b]->valid())
+            return true;
+        uint64_t ka = readers[a]->key(), kb = readers[b]->key();
+        if (ka != kb)
+            return ka < kb;
+        if (levels[a] != levels[b])
+            return levels[a] < levels[b];
+        return readers[a]->getTime() > readers[b]->getTime();
+    };
+    losertree<decltype(before)> tree(readers.size(), before);
+
     // 创建新的SSTable用于存储合并结果
-    sstable newTable;
-    newTable.reset();                                    // 重置SSTable状态，清空所有数据
-    newTable.setTime(++TIME);                           // 设置新的全局时间戳
-    // 构造输出文件路径：目标层级目录/时间戳.sst
-    std::string outPath = targetLevelPath + "/" + std::to_string(TIME) + ".sst";
-    newTable.setFilename(outPath);                      // 设置新SSTable的文件名
+    auto newWriter = [&] {
+        uint64_t newTime = ++TIME; // 分配新的全局时间戳
+        // 构造输出文件路径：目标层级目录/时间戳.sst
+        auto writer = std::make_unique<sstablewriter>(targetLevelPath + "/" + std::to_string(newTime) + ".sst", newTime,
+                                                      options.rateLimiter.get(), options.compactionWriteBufferBytes);
+        writer->setBloomHash(options.bloomHash);
+        return writer;
+    };
+    std::unique_ptr<sstablewriter> newTable = newWriter();
 
     // 用于记录上一个处理的键值，避免重复处理相同的键
     uint64_t lastKey = INF;
 
-    // 多路合并的主循环，直到优先级队列为空
-    while (!pq.empty()) {
-        // 取出优先级最高的条目（键值最小，或键值相同时时间戳最新）
-        poi current = pq.top();
-        pq.pop();
+    // 当前输出表已经跨过的level+2层表，及其累计字节数
+    size_t grandparentIndex = 0;
+    uint64_t overlappedBytes = 0;
+    // 输出key之前是否应该切出新表：键越过的level+2层表都计入当前输出表的重叠量
+    auto shouldStopBefore = [&](uint64_t key) {
+        while (grandparentIndex < grandparents.size() && key > grandparents[grandparentIndex].first) {
+            if (newTable->getCnt() > 0)
+                overlappedBytes += grandparents[grandparentIndex].second;
+            grandparentIndex++;
+        }
+        return overlappedBytes > options.maxGrandparentOverlapBytes;
+    };
 
-        // 提取当前条目的相关信息
-        uint64_t key = current.index.key;               // 当前条目的键
-        int tableId = current.sstableId;                // 来源SSTable的ID
-        int pos = current.pos;                          // 在该SSTable中的位置索引
+    // 输出一个键的最终版本：处理过期、合并过滤器和删除标记，再追加到输出表
+    auto emit = [&](uint64_t key, std::string_view value) {
+        // 已过期的值：读路径已经按不存在处理，最底层之上原样下推（仍要遮住更低层的旧版本），
+        // 到最底层丢弃时才记下，每个键只同步一次HNSW索引。合并过滤器丢弃的键在最底层直接消失，否则写成删除标记
+        std::string changed;
+        bool drop = false;
+        if (isExpired(value, now)) {
+            if (dropDeletes) {
+                removed.push_back(key);
+                drop = true;
+            }
+        } else if (filter && value != DEL && !isMergeRecord(value)) {
+            // 过滤器看到的是去掉过期时间编码的原值，改写后保留原来的过期时刻
+            std::string_view plain  = hasTTL(value) ? ttlValue(value) : value;
+            FilterDecision decision = filter->filter(outputLevel, key, plain, &changed);
+            if (decision == FilterDecision::Remove) {
+                removed.push_back(key);
+                drop  = dropDeletes;
+                value = DEL;
+            } else if (decision == FilterDecision::ChangeValue) {
+                if (hasTTL(value))
+                    changed = encodeTTL(changed, ttlExpireAt(value));
+                value = changed;
+            }
+        }
 
-        // 从对应的SSTable中获取当前位置的数据值
-        std::string value = tables[tableId].getData(pos);
+        // 决定是否保留此条目的逻辑：
+        // 1. 如果值不是删除标记(DEL)，则保留
+        // 2. 如果值是删除标记但不是最底层，也要保留（删除标记需要向下传播）
+        // 3. 只有在最底层才能真正丢弃删除标记
+        if (!drop && (value != DEL || !dropDeletes)) {
+            // 检查新SSTable的大小是否即将超过targetFileSize，或者与level+2层重叠过多
+            bool overlapTooMuch = shouldStopBefore(key);
+            if (!newTable->fits(value.size(), options.targetFileSize) || (overlapTooMuch && newTable->getCnt() > 0)) {
+                // 先将当前SSTable写入磁盘
+                outputs.push_back(newTable->finish());
+                newTable        = newWriter();
+                overlappedBytes = 0;
+            }
 
+            // 将键值对追加到新的SSTable中
+            newTable->add(key, value);
+        }
+    };
+
+    // 合并操作数的折叠：最新版本是操作数时，继续收集同一键更旧的版本，直到遇到基础值
+    const MergeOperator *mergeOperator = options.mergeOperator.get();
+    std::vector<std::string> operands; // 当前键已收集的操作数，从新到旧
+    bool folding = false;
+    // base为nullptr表示输入中没有基础值：在最底层按键不存在折叠，否则把操作数两两合并成一条操作数记录
+    auto fold = [&](uint64_t key, const std::string *base) {
+        std::string res, plain;
+        uint64_t expireAt = 0;
+        const std::string *cur = nullptr;
+        if (base && *base != DEL && !isExpired(*base, now)) {
+            expireAt = hasTTL(*base) ? ttlExpireAt(*base) : 0;
+            plain    = expireAt ? std::string(ttlValue(*base)) : *base;
+            cur      = &plain;
+        }
+        bool partial = !base && !dropDeletes;
+        for (auto it = operands.rbegin(); it != operands.rend(); ++it) {
+            if (partial && !cur) {
+                res = *it;
+            } else
+                res = mergeOperator->merge(key, cur, *it);
+            cur = &res;
+        }
+        if (partial)
+            res = encodeMerge(res);
+        else if (expireAt)
+            res = encodeTTL(res, expireAt);
+        operands.clear();
+        folding = false;
+        emit(key, res);
+    };
+
+    // 多路合并的主循环，直到所有读取器耗尽
+    while (!readers.empty() && readers[tree.top()]->valid()) {
+        // 取出优先级最高的条目（键值最小，或键值相同时版本最新）
+        int id = tree.top();
+        sstablereader &current = *readers[id];
+        uint64_t key = current.key(); // 当前条目的键
 
         if (key == lastKey) {
             // 检查是否与上一个处理的键相同
-            // 如果键相同，跳过此条目（因为优先级队列保证了时间戳最新的在前）
-            // 这样可以保留最新版本的数据，丢弃旧版本
-        } else {
-            // 新的键，需要处理
-            // 判断下一层是否为最底层，这决定了是否可以丢弃删除标记
-            bool isDeepestLevel = (level + 1 == totalLevel);
-
-
-            // 决定是否保留此条目的逻辑：
-            // 1. 如果值不是删除标记(DEL)，则保留
-            // 2. 如果值是删除标记但不是最底层，也要保留（删除标记需要向下传播）
-            // 3. 只有在最底层才能真正丢弃删除标记
-            if (value != DEL || !isDeepestLevel) {
-                // 检查新SSTable的大小是否即将超过2MB限制
-                // 12字节是索引条目大小，value.size()是数据大小
-                if (newTable.getBytes() + 12 + value.size() > MAXSIZE) {
-                    // 如果超过大小限制，先将当前SSTable写入磁盘
-                    newTable.putFile(newTable.getFilename().c_str());
-                    // 将SSTable头信息添加到对应层级的索引中
-                    addsstable(newTable, level + 1);
-
-                    // 重置SSTable准备创建新的文件
-                    newTable.reset();
-                    newTable.setTime(++TIME);           // 分配新的时间戳
-                    // 构造新的输出文件路径
-                    outPath = targetLevelPath + "/" + std::to_string(TIME) + ".sst";
-                    newTable.setFilename(outPath);
+            // 如果键相同，跳过此条目（因为败者树保证了最新版本在前）
+            // 这样可以保留最新版本的数据，丢弃旧版本；正在折叠操作数时则继续收集
+            if (folding) {
+                std::string_view value = current.value();
+                if (isMergeRecord(value))
+                    operands.emplace_back(mergeOperand(value));
+                else {
+                    std::string base(value);
+                    fold(key, &base);
                 }
-
-                // 将键值对插入到新的SSTable中
-                newTable.insert(key, value);
             }
+        } else {
+            // 上一个键的操作数没有遇到基础值
+            if (folding)
+                fold(lastKey, nullptr);
+            // 从读取器缓冲区中取当前位置的数据值，不复制
+            std::string_view value = current.value();
+            if (mergeOperator && isMergeRecord(value)) {
+                operands.emplace_back(mergeOperand(value));
+                folding = true;
+            } else
+                emit(key, value);
             // 更新最后处理的键值
             lastKey = key;
         }
 
-        // 检查当前SSTable是否还有下一个条目
-        if (pos + 1 < tables[tableId].getCnt()) {
-            // 创建下一个条目并加入优先级队列
-            poi next;
-            next.sstableId = tableId;                    // 相同的SSTable ID
-            next.pos = pos + 1;                          // 位置索引加1
-            next.time = current.time;                    // 相同的时间戳
-            next.index = tables[tableId].getIndexById(pos + 1);  // 获取下一个索引条目
-            pq.push(next);                               // 加入优先级队列
-        }
+        // 该读取器前进一步，重赛
+        current.next();
+        tree.adjust(id);
     }
+    if (folding)
+        fold(lastKey, nullptr);
 
     // 处理最后一个SSTable（如果不为空）
-    if (newTable.getCnt() > 0) {
-        // 将最后的SSTable写入磁盘
-        newTable.putFile(newTable.getFilename().c_str());
-        // 将SSTable头信息添加到对应层级的索引中
-        addsstable(newTable, level + 1);
+    if (newTable->getCnt() > 0) {
+        outputs.push_back(newTable->finish());
     }
 
-    // 删除所有参与合并的原始SSTable文件
-    // 这是合并过程的清理步骤，释放磁盘空间
-    for (size_t i = 0; i < selectedTables.size(); i++) {
-        delsstable(selectedTables[i].getFilename());
+    if (!removed.empty()) {
+        std::lock_guard<std::mutex> lock(filteredMutex);
+        filteredKeys.insert(removed.begin(), removed.end());
     }
+}
 
-    // 计算下一层的文件数量阈值
-    // 阈值公式：2^(level+2)，即第1层阈值为8，第2层阈值为16，以此类推
-    int nextLevelThreshold = 1 << (level + 2);
-    // 检查下一层是否也需要进行合并
-    if (sstableIndex[level + 1].size() > nextLevelThreshold) {
-        // 递归调用，对下一层进行合并
-        // 这确保了LSM-Tree的层级结构始终保持平衡
-        compaction(level + 1);
+/**
+ * @brief 把合并中丢弃的键批量同步到HNSW索引和嵌入向量存储，只在前台线程调用
+ *
+ * 合并只看到参与合并的版本，memtable或更上层可能已有更新的值，因此只处理当前get不到的键。
+ * 这些键的嵌入向量经search_embeddings一次查出，embedding.bin至多顺序读一遍
+ */
+void KVStore::applyFilteredKeys() {
+    std::vector<uint64_t> keys;
+    {
+        std::lock_guard<std::mutex> lock(filteredMutex);
+        keys.assign(filteredKeys.begin(), filteredKeys.end());
+        filteredKeys.clear();
+    }
+    if (keys.empty())
+        return;
+    keys.erase(std::remove_if(keys.begin(), keys.end(), [this](uint64_t key) { return get(key) != ""; }),
+               keys.end());
+    for (auto &[key, vec] : search_embeddings(keys)) {
+        // 已经是删除标记
+        if (vec.empty() || vec[0] == std::numeric_limits<float>::max())
+            continue;
+        hnswIndex->del(key, vec);
+        embeddings[key] = std::vector<float>(vec_dim, std::numeric_limits<float>::max());
     }
 }
 
-
+/**
+ * @brief 写入key之前只同步这一个键：它若在合并中被丢弃，旧向量要先从HNSW索引中删除，
+ * 之后的put才能按键不存在插入新向量。其余键留到下一次批量处理，写入不为它们付出代价
+ */
+void KVStore::applyFilteredKey(uint64_t key) {
+    {
+        std::lock_guard<std::mutex> lock(filteredMutex);
+        if (!filteredKeys.erase(key))
+            return;
+    }
+    if (get(key) != "")
+        return;
+    auto found = search_embeddings({key});
+    // 没有嵌入向量，或者已经是删除标记
+    if (found.empty() || found[key].empty() || found[key][0] == std::numeric_limits<float>::max())
+        return;
+    std::vector<float> &vec = found[key];
+    hnswIndex->del(key, vec);
+    embeddings[key] = std::vector<float>(vec_dim, std::numeric_limits<float>::max());
+}
 
 void KVStore::delsstable(std::string filename) {
     for (int level = 0; level <= totalLevel; ++level) {
         int size = sstableIndex[level].size(), flag = 0;
         for (int i = 0; i < size; ++i) {
             if (sstableIndex[level][i].getFilename() == filename) {
+                sstableIndex[level][i].dropCached();
                 sstableIndex[level].erase(sstableIndex[level].begin() + i);
                 flag = 1;
                 break;
@@ -631,6 +1890,7 @@ void KVStore::delsstable(std::string filename) {
         if (flag)
             break;
     }
+    unmapFile(filename);
     int flag = utils::rmfile(filename.data());
     if (flag != 0) {
         std::cout << "delete fail!" << std::endl;
@@ -638,6 +1898,35 @@ void KVStore::delsstable(std::string filename) {
     }
 }
 
+std::shared_ptr<MappedFile> KVStore::mapFile(const std::string &file) {
+    std::lock_guard<std::mutex> lock(mappedMutex);
+    auto it = mappedFiles.find(file);
+    if (it != mappedFiles.end()) {
+        mappedLru.splice(mappedLru.begin(), mappedLru, it->second);
+        return it->second->second;
+    }
+    std::shared_ptr<MappedFile> mapped = MappedFile::open(file);
+    if (!mapped || !options.maxMappedFiles)
+        return mapped;
+    mappedLru.emplace_front(file, mapped);
+    mappedFiles[file] = mappedLru.begin();
+    // 超出上限时解除最久未用的映射，正被钉住的值持有自己的引用，不受影响
+    while (mappedLru.size() > options.maxMappedFiles) {
+        mappedFiles.erase(mappedLru.back().first);
+        mappedLru.pop_back();
+    }
+    return mapped;
+}
+
+void KVStore::unmapFile(const std::string &file) {
+    std::lock_guard<std::mutex> lock(mappedMutex);
+    auto it = mappedFiles.find(file);
+    if (it == mappedFiles.end())
+        return;
+    mappedLru.erase(it->second);
+    mappedFiles.erase(it);
+}
+
 void KVStore::addsstable(sstable ss, int level) {
     sstableIndex[level].push_back(ss.getHead());
 }
@@ -696,6 +1985,8 @@ std::string KVStore::fetchString(std::string file, int startOffset, uint32_t len
 
 // 使用堆排序
 std::vector<std::pair<std::uint64_t, std::string>> KVStore::search_knn(std::string query, int k){
+    // 先同步合并过滤器丢弃的键，避免返回已被过滤的键
+    applyFilteredKeys();
     // 计算查询向量
     std::vector<float> queryVec = getEmbd(query);
 
@@ -731,6 +2022,8 @@ std::vector<std::pair<std::uint64_t, std::string>> KVStore::search_knn(std::stri
 
 
 std::vector<std::pair<std::uint64_t, std::string>> KVStore::search_knn_hnsw(std::string query, int k){
+    // 先同步合并过滤器丢弃的键，避免返回已被过滤的键
+    applyFilteredKeys();
     // 计算查询向量
     std::vector<float> queryVec = getEmbd(query);
     std::vector<uint64_t> result_key = hnswIndex->search_knn_hnsw(queryVec, k);
@@ -821,6 +2114,50 @@ std::vector<float> KVStore::search_embedding(uint64_t key, const std::string &fi
     }
 }
 
+std::unordered_map<uint64_t, std::vector<float>> KVStore::search_embeddings(const std::vector<uint64_t> &keys,
+                                                                             const std::string &filename) {
+    std::unordered_map<uint64_t, std::vector<float>> res;
+    std::unordered_set<uint64_t> pending;
+    for (uint64_t key : keys) {
+        auto it = embeddings.find(key);
+        if (it != embeddings.end())
+            res[key] = it->second; // 可能是删除标记，也可能是嵌入向量
+        else
+            pending.insert(key);
+    }
+    if (pending.empty())
+        return res;
+    std::ifstream infile(filename, std::ios::binary);
+    if (!infile)
+        return res;
+
+    // 与search_embedding相同，从文件末尾按记录对齐向前读，同一个键以最后追加的记录为准
+    const size_t keySize = sizeof(uint64_t), vectorSize = 768 * sizeof(float), recordSize = keySize + vectorSize;
+    const size_t batch = 64; // 每次读入的记录数
+    infile.seekg(0, std::ios::end);
+    size_t records = (size_t)infile.tellg() / recordSize;
+    size_t head    = (size_t)infile.tellg() - records * recordSize; // 文件开头不足一条记录的部分
+    std::vector<char> buf(batch * recordSize);
+    while (records && !pending.empty()) {
+        size_t n = std::min(batch, records);
+        records -= n;
+        infile.seekg(head + records * recordSize, std::ios::beg);
+        if (!infile.read(buf.data(), n * recordSize))
+            break;
+        for (size_t i = n; i-- > 0 && !pending.empty();) {
+            const char *record = buf.data() + i * recordSize;
+            uint64_t key;
+            memcpy(&key, record, keySize);
+            if (!pending.erase(key))
+                continue;
+            std::vector<float> vector(768);
+            memcpy(vector.data(), record + keySize, vectorSize);
+            res[key] = std::move(vector);
+        }
+    }
+    return res;
+}
+
 /**
  * @brief 系统启动时，从磁盘加载嵌入向量，放置到embeddings中
  * @param data_root 存放键-嵌入对的文件路径
@@ -994,6 +2331,8 @@ std::vector<float> KVStore::getEmbd(std::string str) {
 }
 
 std::vector<std::pair<std::uint64_t, std::string>> KVStore::search_knn_hnsw_parallel(std::string query, int k){
+    // 先同步合并过滤器丢弃的键，避免返回已被过滤的键
+    applyFilteredKeys();
     // 计算查询向量
     std::vector<float> queryVec = getEmbd(query);
     std::vector<uint64_t> result_key = hnswIndex->search_knn_hnsw_parallel(queryVec, k);
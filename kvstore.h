@@ -6,45 +6,149 @@
 #define vec_dim 768 // 嵌入向量维数
 
 #include "kvstore_api.h"
-#include "skiplist.h"
+#include "options.h"
+#include "memtable.h"
 #include "sstable.h"
 #include "sstablehead.h"
 #include "embedding.h"
 #include "HNSW.h"
 #include "util.h"
-
+#include "compactionpolicy.h"
+#include "manifest.h"
+#include "hashindex.h"
+#include "pinnablevalue.h"
+
+#include <condition_variable>
+#include <functional>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <shared_mutex>
 #include <unordered_map>
+#include <unordered_set>
+
+class ThreadPool;
 
 class KVStore : public KVStoreAPI {
     // You can add your implementation here
     
 private:
-    skiplist *s = new skiplist(0.5); // memtable
+    memtable *s; // memtable，实现由options.memtableType决定
     // std::vector<sstablehead> sstableIndex;  // sstable的表头缓存
 
-    std::vector<sstablehead> sstableIndex[15]; // the sshead for each level
+    std::vector<std::vector<sstablehead>> sstableIndex; // the sshead for each level，共options.levelCount层
 
     int totalLevel = -1; // 层数
 
+    KVStoreOptions options;
+    std::shared_ptr<CompactionPolicy> policy; // 合并策略
+
+    // sstableIndex/totalLevel的读写锁：get/scan持共享锁，flush与合并安装结果时持独占锁
+    std::shared_mutex indexMutex;
+
+    // 表的增删都记入MANIFEST，重新打开时据此建立sstableIndex而不扫描读取每个文件头
+    std::unique_ptr<Manifest> manifest;
+    // 追加一条版本修改并落盘，需持有indexMutex独占锁；在修改sstableIndex之前调用，失败时抛出异常，内存中的状态不变
+    void logEdit(VersionEdit &edit);
+    void maybeSnapshotManifest();     // 修改条数过多时重写快照，在sstableIndex修改完之后调用
+    void writeManifestSnapshot();     // 以当前sstableIndex重写清单，需持有indexMutex独占锁
+    // 确保与[key1, key2]重叠的表都已读入bloom和索引；需要读文件时临时换成独占锁，返回时仍持有lock
+    void loadHeads(std::shared_lock<std::shared_mutex> &lock, uint64_t key1, uint64_t key2);
+
+    // 各层表在内存中的bloom大小，由bloomBitsPerKey/bloomMemoryBudget/bloomSkipLastLevel决定
+    std::vector<double> levelBitsPerKey; // 各层当前的每键位数，<0表示完整过滤器
+    bool filterTuning() const;           // 是否配置了任何过滤器选项
+    void fitFilter(sstablehead &head, int level);
+    void allocateFilters(); // 表增删后重新分配各层位数并调整已读入的表，需持有indexMutex独占锁
+
+    // 可选的全局哈希索引，由hashIndexBytes开启；与sstableIndex一样受indexMutex保护
+    std::unique_ptr<HashIndex> hashIndex;
+    std::vector<sstablehead *> hashTables; // 表编号 -> sstableIndex中的表头，sstableIndex修改后要重建
+    bool hashMatch(uint64_t key, uint32_t id, uint32_t pos); // 表id的第pos个键是否为key
+    void refreshHashTables();
+    void rebuildHashIndex();                // 清空后按全部表重建
+    void hashIndexAdd(sstablehead &head);   // 加入一个比已有的表都新的表
+    // 合并安装前调用：指向输入表的槽改指输出表中的同一个键，输出中没有的键删掉
+    void hashIndexReplace(std::vector<sstablehead> &inputs, std::vector<sstablehead> &outputs);
+
+    // get(key, PinnableValue&)钉住的表文件映射，按文件名缓存，至多options.maxMappedFiles个，超出时解除最久未用的；
+    // 表删除时去掉，已钉住的值仍持有映射
+    std::mutex mappedMutex;
+    std::list<std::pair<std::string, std::shared_ptr<MappedFile>>> mappedLru; // 表头为最近使用
+    std::unordered_map<std::string, decltype(mappedLru)::iterator> mappedFiles;
+    std::shared_ptr<MappedFile> mapFile(const std::string &file); // 需持有indexMutex，保证文件还没被删除
+    void unmapFile(const std::string &file);
+
+    // 后台合并调度：同一时刻最多一个合并循环在compactionPool上运行
+    ThreadPool *compactionPool = nullptr;
+    std::mutex compactionMutex;
+    std::condition_variable compactionCv; // 每完成一次合并就通知被反压阻塞的写入
+    bool compactionScheduled = false;
+
     HNSWIndex* hnswIndex; // HNSW索引
 
 
     std::unordered_map<uint64_t, std::vector<float>> embeddings;// phase4，存放key-embedding对，支持磁盘读
 
+    // 合并中在最底层丢弃的过期键和被合并过滤器丢弃的键，由前台线程同步到HNSW索引和嵌入向量存储：
+    // 写入时只处理被写的那个键（applyFilteredKey），其余的在向量检索前和关闭时批量处理（applyFilteredKeys）
+    std::mutex filteredMutex;
+    std::unordered_set<uint64_t> filteredKeys;
+    void applyFilteredKeys();
+    void applyFilteredKey(uint64_t key);
+
     std::vector<float> getEmbd(std::string str); // 根据字符串获取嵌入向量，phase5中配合util使用
 
+    // 对[key1, key2]做多路归并，memtable部分取mem[memBegin, memEnd)
+    bool needsCompaction(int level);       // 该层是否需要合并
+    double compactionScore(int level);     // 该层的合并紧迫程度（由合并策略给出），>=1表示需要合并
+    int pickCompactionLevel();             // 分数最高且>=1的层，没有则返回-1
+    uint64_t pendingCompactionBytes();     // 估算尚待合并的字节数
+    void compactOnce(int level, int manualOutputLevel = -1, uint64_t key1 = 0,
+                     uint64_t key2 = INF);   // 执行一次level->level+1的合并（不递归）
+    bool flushMemtable();                  // memtable写成第0层的新表，memtable为空时返回false
+    std::vector<uint64_t> flushBoundaries(); // 第0层分区时flush的切点，不分区时为空
+    int level0Runs();                        // 第0层点查最多探测的表数，用于写入反压；调用方需持有indexMutex
+    // 输入表互不重叠且不与下一层重叠时，只移动文件而不重写
+    bool trivialMove(int level, std::vector<sstablehead> &inputs, const std::vector<int> &levels, bool dropDeletes);
+    // 把inputs中[lo, hi]内的条目流式归并成outputLevel层的新表，子合并的单个切片
+    void mergeRange(std::vector<sstablehead> &inputs, const std::vector<int> &levels, uint64_t lo, uint64_t hi,
+                    int outputLevel, bool dropDeletes,
+                    const std::vector<std::pair<uint64_t, uint64_t>> &grandparents, std::vector<sstablehead> &outputs);
+    void maybeScheduleCompaction();        // 若有层需要合并且后台空闲，则提交后台合并任务
+    void backgroundCompaction();           // 后台循环：按分数挑层合并，直到所有层都不超阈值
+    void waitForCompaction();              // 等待后台合并全部完成
+    void throttleWrites();                 // flush前根据第0层文件数和待合并字节数减速或停写
+
+    void putEntry(uint64_t key, const std::string &val, const std::string &stored); // put的实现，stored为实际存储的值
+    void writeMemtable(uint64_t key, const std::string &stored);                  // 写入memtable，写满时落盘
+    std::string mergedValue(uint64_t key); // 折叠key的合并操作数与基础值，需持有indexMutex共享锁
+
+    void scanRange(uint64_t key1, uint64_t key2, const std::vector<std::pair<uint64_t, std::string>> &mem,
+                   size_t memBegin, size_t memEnd, std::vector<std::pair<uint64_t, std::string>> &res);
+
 
 public:
-    KVStore(const std::string &dir);
+    KVStore(const std::string &dir, const KVStoreOptions &options = KVStoreOptions());
 
     ~KVStore();
 
     void put(uint64_t key, const std::string &s) override;
 
+    // 写入ttlMillis毫秒后过期的键值对，过期后读不到，合并到最底层时被丢弃
+    void put(uint64_t key, const std::string &s, uint64_t ttlMillis);
+
+    // 记一个合并操作数，由options.mergeOperator在get和合并时折叠，不需要先get
+    void merge(uint64_t key, const std::string &operand);
+
     std::string get(uint64_t key) override;
 
+    // 与get相同，但值在SSTable中时不复制：value直接指向钉住的文件映射，合并删除该表后仍然有效。
+    // 返回是否找到；memtable中的值和合并操作数折叠的结果仍是一份副本
+    bool get(uint64_t key, PinnableValue &value);
+
     bool del(uint64_t key) override;
 
     void reset() override;
@@ -52,7 +156,27 @@ public:
 
     void scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list) override;
 
-    void compaction(int level = 0);// 默认合并第0层
+    // 并行范围查询，按键切分子区间并行归并；callback按顺序接收每个子区间的结果块
+    // callback执行期间持有索引读锁，不能在其中写入本KVStore
+    using ScanCallback = std::function<void(std::vector<std::pair<uint64_t, std::string>> &)>;
+    void scan_parallel(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string>> &list);
+    void scan_parallel(uint64_t key1, uint64_t key2, const ScanCallback &callback);
+
+    void compaction(int level = 0);// 默认合并第0层；后台模式下只负责调度
+
+    // 手动合并：把与[key1, key2]重叠的数据推到最底层，丢弃旧版本和删除标记，返回时已完成
+    void compactRange(uint64_t key1, uint64_t key2);
+    void compactAll();
+
+    CompactionPolicy *getCompactionPolicy() {
+        return policy.get();
+    }
+
+    uint64_t filterMemory(); // 所有表常驻内存的bloom字节数，不含元数据缓存中的
+
+    double writeAmplification() {
+        return policy->writeAmplification();
+    }
 
     void delsstable(std::string filename);  // 从缓存中删除filename.sst， 并物理删除
     void addsstable(sstable ss, int level); // 将ss加入缓存
@@ -61,6 +185,9 @@ public:
 
     // 持久化存储嵌入向量
     std::vector<float> search_embedding(uint64_t key, const std::string &filename = key_embedding_store);
+    // 一次查多个键：内存中没有的键在文件中从后往前按块顺序读一遍，找齐即停；找不到的键不出现在结果中
+    std::unordered_map<uint64_t, std::vector<float>> search_embeddings(const std::vector<uint64_t> &keys,
+                                                                       const std::string &filename = key_embedding_store);
     void save_embedding_to_disk(const std::string &filename = key_embedding_store);
     void load_embedding_from_disk(const std::string &data_root = key_embedding_store);
 
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+/**
+ * @brief 败者树，用于k路归并
+ *
+ * 叶子为0..k-1号输入源，内部结点保存该子树比赛中的败者，tree[0]保存总冠军。
+ * 某一路前进一步后只需沿叶子到根重赛一次(log k次比较)，比堆的弹出+插入少一半比较。
+ * Before(a, b)为true表示a应先输出；已耗尽的输入源应排在所有未耗尽的之后。
+ */
+template <class Before>
+class losertree {
+private:
+    int k;
+    Before before;
+    std::vector<int> tree;
+
+    // k号是建树用的哨兵，视为比任何输入源都小
+    bool beats(int a, int b) {
+        if (a == k)
+            return true;
+        if (b == k)
+            return false;
+        return before(a, b);
+    }
+
+public:
+    losertree(int k, Before before) : k(k), before(before) {
+        tree.assign(std::max(k, 1), k);
+        for (int i = k - 1; i >= 0; --i)
+            adjust(i);
+    }
+
+    // 当前应输出的输入源编号
+    int top() const {
+        return tree[0];
+    }
+
+    // 第s路前进（或耗尽）后，沿叶子到根重赛
+    void adjust(int s) {
+        for (int t = (s + k) >> 1; t > 0; t >>= 1) {
+            if (beats(tree[t], s))
+                std::swap(s, tree[t]);
+        }
+        tree[0] = s;
+    }
+};
@@ -0,0 +1,208 @@
+#include "manifest.h"
+
+#include "MurmurHash3.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+
+static uint32_t checksum(const std::string &data) {
+    uint32_t hash[4];
+    MurmurHash3_x64_128(data.data(), data.size(), 1, hash);
+    return hash[0];
+}
+
+template <typename T> static void putFixed(std::string &dst, T v) {
+    dst.append((const char *)&v, sizeof(T));
+}
+
+static void putString(std::string &dst, const std::string &s) {
+    putFixed<uint32_t>(dst, s.size());
+    dst.append(s);
+}
+
+/**
+ * @brief 记录内容的顺序读取，越界时置ok为false
+ */
+struct RecordReader {
+    const std::string &data;
+    size_t pos = 0;
+    bool ok    = true;
+
+    explicit RecordReader(const std::string &data) : data(data) {}
+
+    template <typename T> T getFixed() {
+        T v{};
+        if (pos + sizeof(T) > data.size()) {
+            ok = false;
+            return v;
+        }
+        memcpy(&v, data.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return v;
+    }
+
+    std::string getString() {
+        uint32_t len = getFixed<uint32_t>();
+        if (!ok || pos + len > data.size()) {
+            ok = false;
+            return "";
+        }
+        std::string s = data.substr(pos, len);
+        pos += len;
+        return s;
+    }
+};
+
+Manifest::Manifest(const std::string &path) : path(path) {}
+
+Manifest::~Manifest() {
+    if (file)
+        fclose(file);
+}
+
+bool Manifest::exists() const {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    fclose(f);
+    return true;
+}
+
+bool Manifest::replay(std::vector<std::vector<TableMeta>> &levels, uint64_t &maxTime) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    std::map<std::string, TableMeta> tables; // 文件名 -> 元数据
+    maxTime = 0;
+    edits   = 0;
+    while (true) {
+        uint32_t len, sum;
+        if (fread(&len, 4, 1, f) != 1 || fread(&sum, 4, 1, f) != 1)
+            break;
+        std::string data(len, '\0');
+        if (fread(data.data(), 1, len, f) != len || checksum(data) != sum)
+            break; // 写了一半的记录
+        RecordReader in(data);
+        VersionEdit edit;
+        edit.maxTime   = in.getFixed<uint64_t>();
+        uint32_t added = in.getFixed<uint32_t>();
+        for (uint32_t i = 0; in.ok && i < added; ++i) {
+            TableMeta meta;
+            meta.level     = in.getFixed<int32_t>();
+            meta.filename  = in.getString();
+            meta.time      = in.getFixed<uint64_t>();
+            meta.cnt       = in.getFixed<uint64_t>();
+            meta.minV      = in.getFixed<uint64_t>();
+            meta.maxV      = in.getFixed<uint64_t>();
+            meta.delCnt    = in.getFixed<uint64_t>();
+            meta.bytes     = in.getFixed<uint32_t>();
+            meta.bloomHash = (BloomHashKind)in.getFixed<uint8_t>();
+            edit.added.push_back(meta);
+        }
+        uint32_t deleted = in.getFixed<uint32_t>();
+        for (uint32_t i = 0; in.ok && i < deleted; ++i)
+            edit.deleted.push_back(in.getString());
+        if (!in.ok)
+            break;
+        // 同一条修改中先删后加，平凡移动删除旧文件名、加入新文件名
+        for (auto &name : edit.deleted)
+            tables.erase(name);
+        for (auto &meta : edit.added)
+            tables[meta.filename] = meta;
+        maxTime = std::max(maxTime, edit.maxTime);
+        edits++;
+    }
+    fclose(f);
+    // 第一条是快照，读不出来时清单不可信，不能据此判断哪些文件已失效
+    if (!edits) {
+        std::cout << "MANIFEST " << path << " has no valid snapshot" << std::endl;
+        return false;
+    }
+
+    for (auto &level : levels)
+        level.clear();
+    for (auto &[name, meta] : tables) {
+        if (meta.level >= (int)levels.size())
+            levels.resize(meta.level + 1);
+        levels[meta.level].push_back(meta);
+        maxTime = std::max(maxTime, meta.time);
+    }
+    for (auto &level : levels) {
+        std::sort(level.begin(), level.end(),
+                  [](const TableMeta &a, const TableMeta &b) { return a.time < b.time; });
+    }
+    return true;
+}
+
+void Manifest::writeRecord(const VersionEdit &edit) {
+    std::string data;
+    putFixed<uint64_t>(data, edit.maxTime);
+    putFixed<uint32_t>(data, edit.added.size());
+    for (auto &meta : edit.added) {
+        putFixed<int32_t>(data, meta.level);
+        putString(data, meta.filename);
+        putFixed<uint64_t>(data, meta.time);
+        putFixed<uint64_t>(data, meta.cnt);
+        putFixed<uint64_t>(data, meta.minV);
+        putFixed<uint64_t>(data, meta.maxV);
+        putFixed<uint64_t>(data, meta.delCnt);
+        putFixed<uint32_t>(data, meta.bytes);
+        putFixed<uint8_t>(data, (uint8_t)meta.bloomHash);
+    }
+    putFixed<uint32_t>(data, edit.deleted.size());
+    for (auto &name : edit.deleted)
+        putString(data, name);
+
+    uint32_t len = data.size(), sum = checksum(data);
+    bool ok = fwrite(&len, 4, 1, file) == 1 && fwrite(&sum, 4, 1, file) == 1 &&
+              fwrite(data.data(), 1, data.size(), file) == data.size();
+    // 记录落盘之后调用方才会删除被它删掉的表
+    if (!ok || utils::syncfile(file) != 0)
+        throw std::runtime_error("Failed to write MANIFEST: " + path);
+}
+
+void Manifest::snapshot(const std::vector<std::vector<TableMeta>> &levels, uint64_t maxTime) {
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+    VersionEdit edit;
+    edit.maxTime = maxTime;
+    for (auto &level : levels)
+        edit.added.insert(edit.added.end(), level.begin(), level.end());
+
+    std::string tmp = path + ".tmp";
+    file            = fopen(tmp.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("Failed to open file: " + tmp);
+    try {
+        writeRecord(edit); // 改名之前快照已经落盘
+    } catch (...) {
+        fclose(file);
+        file = nullptr;
+        utils::rmfile(tmp.c_str());
+        throw;
+    }
+    fclose(file);
+    file = nullptr;
+    // 改名是原子的，崩溃时要么是旧日志，要么是完整的新快照
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        utils::rmfile(tmp.c_str());
+        throw std::runtime_error("Failed to rename " + tmp);
+    }
+    file  = fopen(path.c_str(), "ab");
+    edits = 0;
+}
+
+void Manifest::append(const VersionEdit &edit) {
+    if (!file)
+        file = fopen(path.c_str(), "ab");
+    if (!file)
+        throw std::runtime_error("Failed to open file: " + path);
+    writeRecord(edit);
+    edits++;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#ifndef LSM_KV_MANIFEST_H
+#define LSM_KV_MANIFEST_H
+
+#include "options.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 清单中一张表的元数据，足以在不读文件的情况下建立表头
+ */
+struct TableMeta {
+    int level = 0;
+    std::string filename;
+    uint64_t time           = 0;
+    uint64_t cnt            = 0;
+    uint64_t minV           = 0;
+    uint64_t maxV           = 0;
+    uint64_t delCnt         = 0;
+    uint32_t bytes          = 0;
+    BloomHashKind bloomHash = BloomHashKind::Murmur3;
+};
+
+/**
+ * @brief 一次版本修改：新增的表、删除的表（按文件名）和修改时的最大时间戳
+ */
+struct VersionEdit {
+    std::vector<TableMeta> added;
+    std::vector<std::string> deleted;
+    uint64_t maxTime = 0;
+};
+
+/**
+ * @brief MANIFEST：只追加的版本修改日志，重放即得到当前每层有哪些表
+ *
+ * 每条记录为 4字节长度 + 4字节校验 + 内容。崩溃时最后一条记录可能写了一半，
+ * 重放在第一条长度或校验不对的记录处停止，之前的修改仍然有效。
+ * 日志开头是一份完整快照（所有表的新增），打开时和修改条数过多时重写快照以限制日志长度。
+ * 调用方负责串行化append/snapshot（KVStore在indexMutex独占锁下调用）。
+ * 每条记录返回前都已落盘，调用方在它之后才能删除记录中删掉的表
+ */
+class Manifest {
+private:
+    std::string path;
+    FILE *file     = nullptr;
+    uint64_t edits = 0; // 快照之后追加的修改条数
+
+    void writeRecord(const VersionEdit &edit);
+
+public:
+    static constexpr uint64_t SNAPSHOT_EDITS = 4096; // 追加这么多条修改后重写快照
+
+    explicit Manifest(const std::string &path);
+    ~Manifest();
+
+    bool exists() const;
+
+    // 重放日志，levels按层返回当前的表（层内按时间戳排序），maxTime为记录过的最大时间戳。
+    // 只容忍末尾写了一半的记录；文件不存在、为空或第一条（快照）损坏时返回false
+    bool replay(std::vector<std::vector<TableMeta>> &levels, uint64_t &maxTime);
+
+    // 以当前全部表写一份快照，先写临时文件并落盘，再改名替换旧日志；失败时抛出runtime_error，旧日志不变
+    void snapshot(const std::vector<std::vector<TableMeta>> &levels, uint64_t maxTime);
+
+    // 追加一条修改并落盘（fdatasync），失败时抛出runtime_error
+    void append(const VersionEdit &edit);
+
+    bool needsSnapshot() const {
+        return edits >= SNAPSHOT_EDITS;
+    }
+};
+
+#endif // LSM_KV_MANIFEST_H
@@ -0,0 +1,13 @@
+#include "memtable.h"
+
+#include "hashvector.h"
+#include "radixtree.h"
+#include "skiplist.h"
+
+memtable *newMemtable(MemtableType type) {
+    if (type == MemtableType::RadixTree)
+        return new radixtree();
+    if (type == MemtableType::HashVector)
+        return new hashvector();
+    return new skiplist(0.5);
+}
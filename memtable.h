@@ -0,0 +1,42 @@
+#pragma once
+
+#ifndef LSM_KV_MEMTABLE_H
+#define LSM_KV_MEMTABLE_H
+
+#include "options.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief memtable的公共接口：按uint64_t键有序的内存表，KVStore经它写入、点查、范围查询，落盘时按键顺序遍历
+ *
+ * 不加锁，调用方负责同步
+ */
+class memtable {
+public:
+    virtual ~memtable() = default;
+
+    virtual void insert(uint64_t key, const std::string &str) = 0; // 键已存在时覆盖值
+    virtual std::string search(uint64_t key) = 0;                   // 不存在返回空串
+    // 按键升序追加[key1, key2]内的条目
+    virtual void scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) = 0;
+    virtual void reset() = 0;
+    virtual uint32_t getBytes() = 0; // 落盘后索引和数据区的字节数：每条12字节加值的长度
+    virtual bool empty() = 0;
+
+    // 按键升序遍历[key1, key2]内的条目，遍历期间不能修改
+    virtual void forEach(uint64_t key1, uint64_t key2, const std::function<void(uint64_t, const std::string &)> &fn) = 0;
+
+    void forEach(const std::function<void(uint64_t, const std::string &)> &fn) {
+        forEach(0, UINT64_MAX, fn);
+    }
+};
+
+// 按options.memtableType创建memtable
+memtable *newMemtable(MemtableType type);
+
+#endif // LSM_KV_MEMTABLE_H
@@ -0,0 +1,25 @@
+#include "mergeoperator.h"
+
+#include <charconv>
+
+static uint64_t parseUInt64(std::string_view str) {
+    uint64_t res = 0;
+    std::from_chars(str.data(), str.data() + str.size(), res);
+    return res;
+}
+
+std::string UInt64AddOperator::merge(uint64_t key, const std::string *existing, std::string_view operand) const {
+    uint64_t base = existing ? parseUInt64(*existing) : 0;
+    return std::to_string(base + parseUInt64(operand));
+}
+
+std::string StringAppendOperator::merge(uint64_t key, const std::string *existing, std::string_view operand) const {
+    if (!existing)
+        return std::string(operand);
+    std::string res;
+    res.reserve(existing->size() + delimiter.size() + operand.size());
+    res.append(*existing);
+    res.append(delimiter);
+    res.append(operand);
+    return res;
+}
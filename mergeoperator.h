@@ -0,0 +1,78 @@
+#pragma once
+
+#ifndef LSM_KV_MERGEOPERATOR_H
+#define LSM_KV_MERGEOPERATOR_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief 合并操作数的编码：MERGE_PREFIX + 操作数
+ *
+ * merge写入的是操作数记录而不是值，get和合并时再与更旧的版本折叠。和DEL一样是值内的保留格式
+ */
+inline const std::string MERGE_PREFIX = "~MERGE~";
+
+inline std::string encodeMerge(std::string_view operand) {
+    std::string res;
+    res.reserve(MERGE_PREFIX.size() + operand.size());
+    res.append(MERGE_PREFIX);
+    res.append(operand);
+    return res;
+}
+
+inline bool isMergeRecord(std::string_view value) {
+    return value.size() >= MERGE_PREFIX.size() && value.compare(0, MERGE_PREFIX.size(), MERGE_PREFIX) == 0;
+}
+
+inline std::string_view mergeOperand(std::string_view value) {
+    return value.substr(MERGE_PREFIX.size());
+}
+
+/**
+ * @brief 满足结合律的合并操作：merge(merge(a, b), c) == merge(a, merge(b, c))
+ *
+ * 因此在找不到基础值时，多个操作数可以先两两合并成一个操作数写回，等遇到基础值或到达最底层再折叠。
+ * 同一个数据目录必须始终用同一个合并操作打开。可能在多个子合并线程上并发调用，实现需要线程安全
+ */
+class MergeOperator {
+public:
+    virtual ~MergeOperator() = default;
+
+    virtual const char *name() const = 0;
+
+    // existing为nullptr表示键不存在（或已删除、已过期）
+    virtual std::string merge(uint64_t key, const std::string *existing, std::string_view operand) const = 0;
+};
+
+/**
+ * @brief 十进制计数器：值和操作数都按十进制无符号整数解析（无法解析时视为0），结果为两者之和
+ */
+class UInt64AddOperator : public MergeOperator {
+public:
+    const char *name() const override {
+        return "uint64add";
+    }
+
+    std::string merge(uint64_t key, const std::string *existing, std::string_view operand) const override;
+};
+
+/**
+ * @brief 字符串追加：结果为 原值 + delimiter + 操作数，原值不存在时为操作数本身
+ */
+class StringAppendOperator : public MergeOperator {
+private:
+    std::string delimiter;
+
+public:
+    explicit StringAppendOperator(const std::string &delimiter = ",") : delimiter(delimiter) {}
+
+    const char *name() const override {
+        return "stringappend";
+    }
+
+    std::string merge(uint64_t key, const std::string *existing, std::string_view operand) const override;
+};
+
+#endif // LSM_KV_MERGEOPERATOR_H
@@ -0,0 +1,63 @@
+#include "metacache.h"
+
+#include <algorithm>
+
+MetaCache::MetaCache(size_t capacity, int shardCount) : capacity(capacity), shards(std::max(1, shardCount)) {}
+
+std::shared_ptr<const void> MetaCache::lookup(uint64_t table, uint32_t block) {
+    Key key(table, block);
+    Shard &shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return it->second->value;
+}
+
+void MetaCache::insert(uint64_t table, uint32_t block, std::shared_ptr<const void> value, size_t charge) {
+    Key key(table, block);
+    Shard &shard = shardOf(key);
+    size_t limit = capacity / shards.size();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it != shard.map.end()) {
+        shard.usage -= it->second->charge;
+        shard.lru.erase(it->second);
+        shard.map.erase(it);
+    }
+    shard.lru.push_front(Entry{key, std::move(value), charge});
+    shard.map[key] = shard.lru.begin();
+    shard.usage += charge;
+    // 刚插入的条目即使单独超过分片容量也保留，调用方已经持有它
+    while (shard.usage > limit && shard.lru.size() > 1) {
+        Entry &victim = shard.lru.back();
+        shard.usage -= victim.charge;
+        shard.map.erase(victim.key);
+        shard.lru.pop_back();
+    }
+}
+
+void MetaCache::erase(uint64_t table, uint32_t block) {
+    Key key(table, block);
+    Shard &shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it == shard.map.end())
+        return;
+    shard.usage -= it->second->charge;
+    shard.lru.erase(it->second);
+    shard.map.erase(it);
+}
+
+size_t MetaCache::getUsage() {
+    size_t res = 0;
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        res += shard.usage;
+    }
+    return res;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#ifndef LSM_KV_METACACHE_H
+#define LSM_KV_METACACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief 表元数据（索引分区与bloom过滤器）的LRU缓存，按字节数限制总量，多个KVStore可以共享同一个实例
+ *
+ * 键为(表号, 块号)，表号由newId分配、在进程内唯一：各个KVStore的时间戳各自从1开始，
+ * 清空目录后也会重用，不能作为共享缓存的键。值用shared_ptr持有，被淘汰时正在使用它的读者不受影响。
+ * 按键哈希分成若干分片，每个分片一把锁、一条LRU链，容量平分到各分片
+ */
+class MetaCache {
+public:
+    static constexpr uint32_t FILTER_BLOCK = UINT32_MAX; // 过滤器的块号，索引分区的块号为分区下标
+
+private:
+    using Key = std::pair<uint64_t, uint32_t>;
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const {
+            return std::hash<uint64_t>()(key.first * 0x9e3779b97f4a7c15ULL ^ key.second);
+        }
+    };
+
+    struct Entry {
+        Key key;
+        std::shared_ptr<const void> value;
+        size_t charge;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru; // 表头为最近使用
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> map;
+        size_t usage = 0;
+    };
+
+    size_t capacity;
+    std::vector<Shard> shards;
+    std::atomic<uint64_t> hits{0}, misses{0};
+    std::atomic<uint64_t> nextId{1};
+
+    Shard &shardOf(const Key &key) {
+        return shards[KeyHash()(key) % shards.size()];
+    }
+
+public:
+    explicit MetaCache(size_t capacity, int shardCount = 16);
+
+    // 为一张表分配缓存中的表号，0保留为未分配
+    uint64_t newId() {
+        return nextId++;
+    }
+
+    // 命中时移到LRU表头；不存在返回nullptr
+    std::shared_ptr<const void> lookup(uint64_t table, uint32_t block);
+
+    // 插入或替换，随后淘汰分片中最久未用的条目直到不超过分片容量
+    void insert(uint64_t table, uint32_t block, std::shared_ptr<const void> value, size_t charge);
+
+    void erase(uint64_t table, uint32_t block);
+
+    size_t getCapacity() const {
+        return capacity;
+    }
+
+    size_t getUsage();
+
+    uint64_t getHits() const {
+        return hits;
+    }
+
+    uint64_t getMisses() const {
+        return misses;
+    }
+};
+
+#endif // LSM_KV_METACACHE_H
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class CompactionPolicy;
+class RateLimiter;
+class CompactionFilter;
+class MergeOperator;
+class MetaCache;
+
+enum class CompactionStyle {
+    Leveled, // 分层合并（默认），读放大低
+    Tiered   // 分级(size-tiered/universal)合并，写放大低
+};
+
+enum class CompactionPickMode {
+    MinOverlap, // 选与下一层重叠最少的相邻表，删除标记多的优先
+    RoundRobin  // 按每层持久化的游标轮转选表
+};
+
+enum class MemtableType {
+    SkipList, // 跳表（默认）
+    RadixTree, // 自适应基数树，按键的8个字节分支，查找和插入的缓存缺失更少
+    HashVector // 追加写入的数组加哈希索引，落盘时才排序；适合写完才读的批量导入
+};
+
+enum class BloomHashKind {
+    Murmur3 = 0, // MurmurHash3_x64_128（默认）
+    Mix64   = 1  // 64位整数混合函数加双重哈希，探测更快
+};
+
+/**
+ * @brief KVStore的可调参数，构造KVStore时传入；默认值保持原有的同步行为
+ */
+struct KVStoreOptions {
+    // ---- memtable ----
+    MemtableType memtableType = MemtableType::SkipList; // memtable的实现，只影响内存中的结构，不影响文件格式
+
+    // ---- 后台合并与写入反压 ----
+    bool backgroundCompaction = false; // true时compaction在专用线程池中异步执行，put只负责flush
+    int compactionThreads     = 1;     // 后台合并线程池的线程数
+    int maxSubcompactions     = 1;     // 单次合并按键范围切成的最多切片数，每个切片一个线程
+
+    size_t compactionReadaheadBytes = 256 << 10; // 合并时每个输入表的顺序读缓冲区大小
+    size_t compactionWriteBufferBytes = 1 << 20; // 合并时每个输出表的写缓冲区大小，写满一块写一次
+    // 合并输出表与level+2层重叠的字节数超过该值时切出新表，避免之后的合并过大；0表示不限制
+    uint64_t maxGrandparentOverlapBytes = 20 << 20;
+    // 非空时flush(高优先级)和合并(低优先级)的读写都经过该限速器，get读盘的耗时也上报给它
+    std::shared_ptr<RateLimiter> rateLimiter;
+
+    // 非空时合并归并中每个键的最新版本都交给它决定保留、丢弃或改写，见compactionfilter.h
+    std::shared_ptr<CompactionFilter> compactionFilter;
+    // merge()使用的合并操作，见mergeoperator.h；同一数据目录必须始终使用同一个
+    std::shared_ptr<MergeOperator> mergeOperator;
+
+    // ---- 层级大小 ----
+    int levelCount             = 15;      // 最多的层数（含第0层），至少为2
+    uint32_t targetFileSize    = 2 << 20; // memtable落盘与合并输出的单表大小上限（字节）
+    int level0CompactionTrigger = 3;      // Leveled策略下第0层文件数达到该值时合并
+    // >1时每次flush按键范围切成至多这么多个第0层表，切点取第1层表的边界（第1层表太少时按memtable的键均分）；
+    // 点查在第0层每个分区只探测一个表，第0层改按重叠深度触发合并，各分区分别下推、并行归并。只在第1层内表互不重叠的策略（Leveled）下生效
+    int level0Partitions = 1;
+    uint64_t maxBytesForLevelBase = 16 << 20; // Leveled策略下第1层的目标字节数
+    double levelSizeRatio         = 2;        // 相邻两层目标字节数之比（扇出）
+    // true时各层目标由最底层的实际大小反推：第level层目标 = 最底层字节数 / ratio^(最底层 - level)，
+    // 上层总量始终不超过最底层的1/(ratio-1)，空间放大与数据量无关
+    bool dynamicLevelBytes = false;
+
+    // ---- 读路径 ----
+    // 新写出的表的bloom哈希函数；每个表的哈希函数记在清单中，切换后旧表仍按原来的函数查找
+    BloomHashKind bloomHash = BloomHashKind::Murmur3;
+    // 第level层的表在内存中保留的每键bloom位数，超出下标的层沿用最后一个值；为空时保留文件中完整的10240字节。
+    // 内存中的过滤器由文件中的折叠而来，每键位数最多为 81920 / 条目数
+    std::vector<double> bloomBitsPerKey;
+    // 非0时按Monkey方法把这么多字节的过滤器内存按各层条目数分配，优先于bloomBitsPerKey
+    uint64_t bloomMemoryBudget = 0;
+    // 最底层的表不要过滤器：存在的键多数在最底层命中，过滤器只对不存在的键有用，却占了大部分内存
+    bool bloomSkipLastLevel = false;
+    // 非空时各表的索引分区和过滤器不常驻内存，按需读入这个共享的LRU缓存，常驻的只有每表的顶层索引；
+    // 为空时全部常驻（原有行为）
+    std::shared_ptr<MetaCache> metadataCache;
+    // 非0时维护一个这么多字节的全局哈希索引（键 -> 表和表内下标，每键8字节），点查命中时一次探测加一次读盘；
+    // 装不下全部键时查不到的键退回逐层查找。打开时要读入所有表的索引来建立它
+    uint64_t hashIndexBytes = 0;
+    // get(key, PinnableValue&)缓存的表文件映射数上限，超出时解除最久未用的映射（已钉住的值仍持有它）；
+    // 0表示不缓存，每次读都重新映射
+    size_t maxMappedFiles = 256;
+
+    // ---- 合并策略 ----
+    CompactionStyle compactionStyle = CompactionStyle::Leveled;
+    int tieredRunsPerLevel          = 4;       // Tiered策略下每层容纳的段数
+    CompactionPickMode compactionPick = CompactionPickMode::MinOverlap; // Leveled策略第1层及以下的选表方式
+    std::shared_ptr<CompactionPolicy> compactionPolicy; // 非空时使用自定义策略，忽略compactionStyle
+
+    int level0SlowdownTrigger = 8;  // 第0层文件数达到该值时，每次flush前减速
+    int level0StopTrigger     = 12; // 第0层文件数达到该值时，flush阻塞直到合并追上
+
+    uint64_t pendingCompactionBytesSlowdown = 64ull << 20;  // 待合并字节数的减速阈值
+    uint64_t pendingCompactionBytesStop     = 256ull << 20; // 待合并字节数的停写阈值
+    int slowdownMicros                      = 1000;         // 每次减速时flush前的休眠时间（微秒）
+};
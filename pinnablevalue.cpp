@@ -0,0 +1,40 @@
+#include "pinnablevalue.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string &path) {
+#if defined(__linux__) || defined(__APPLE__)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // 映射不依赖文件描述符
+    if (addr == MAP_FAILED)
+        return nullptr;
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->addr   = (const char *)addr;
+    file->length = st.st_size;
+    return file;
+#else
+    // Windows上被映射的文件不能删除，会阻塞合并删除输入表，不映射
+    (void)path;
+    return nullptr;
+#endif
+}
+
+MappedFile::~MappedFile() {
+#if defined(__linux__) || defined(__APPLE__)
+    if (addr)
+        munmap((void *)addr, length);
+#endif
+}
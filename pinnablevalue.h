@@ -0,0 +1,104 @@
+#pragma once
+
+#ifndef LSM_KV_PINNABLEVALUE_H
+#define LSM_KV_PINNABLEVALUE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief 只读映射整个SSTable文件，析构时解除映射
+ *
+ * SSTable写完后不再修改，映射之后文件被删除（合并）也不影响已有的映射，
+ * 所以持有shared_ptr的读者在表被删除后仍可以访问其中的值
+ */
+class MappedFile {
+private:
+    const char *addr = nullptr;
+    size_t length    = 0;
+
+    MappedFile() = default;
+
+public:
+    // 映射失败（或平台不支持）时返回nullptr，调用方退回按偏移读文件
+    static std::shared_ptr<MappedFile> open(const std::string &path);
+
+    ~MappedFile();
+    MappedFile(const MappedFile &)            = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const {
+        return addr;
+    }
+
+    size_t size() const {
+        return length;
+    }
+};
+
+/**
+ * @brief get(key, PinnableValue&)的结果：钉住的内存中的一段，或自有的一份副本
+ *
+ * 值在SSTable中时指向文件映射，不复制，持有映射的引用直到reset或析构；
+ * 值在memtable中（节点会被原地覆盖）或由合并操作数折叠而来时，保存一份副本
+ */
+class PinnableValue {
+private:
+    std::string buf;                  // 自有的副本
+    std::shared_ptr<const void> pin;  // 钉住的内存的所有者，非空时值为[ptr, ptr + len)
+    const char *ptr = nullptr;
+    size_t len      = 0;
+
+public:
+    PinnableValue() = default;
+    PinnableValue(PinnableValue &&)            = default;
+    PinnableValue &operator=(PinnableValue &&) = default;
+    PinnableValue(const PinnableValue &)            = delete;
+    PinnableValue &operator=(const PinnableValue &) = delete;
+
+    // 指向owner所持有内存中的value，owner在本对象reset或析构前不会释放
+    void pinSlice(std::shared_ptr<const void> owner, std::string_view value) {
+        buf.clear();
+        pin = std::move(owner);
+        ptr = value.data();
+        len = value.size();
+    }
+
+    void assign(std::string value) {
+        pin.reset();
+        buf = std::move(value);
+    }
+
+    void reset() {
+        pin.reset();
+        buf.clear();
+    }
+
+    bool isPinned() const {
+        return pin != nullptr;
+    }
+
+    const char *data() const {
+        return pin ? ptr : buf.data();
+    }
+
+    size_t size() const {
+        return pin ? len : buf.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    std::string_view view() const {
+        return std::string_view(data(), size());
+    }
+
+    std::string toString() const {
+        return std::string(view());
+    }
+};
+
+#endif // LSM_KV_PINNABLEVALUE_H
@@ -0,0 +1,310 @@
+#include "radixtree.h"
+
+#include <algorithm>
+#include <cstring>
+
+radixtree::~radixtree() {
+    freeNode(root);
+}
+
+void radixtree::freeNode(node *n) {
+    if (!n)
+        return;
+    switch (n->type) {
+    case LEAF:
+        delete (leaf *)n;
+        return;
+    case NODE4: {
+        auto *p = (node4 *)n;
+        for (int i = 0; i < p->count; ++i)
+            freeNode(p->child[i]);
+        delete p;
+        return;
+    }
+    case NODE16: {
+        auto *p = (node16 *)n;
+        for (int i = 0; i < p->count; ++i)
+            freeNode(p->child[i]);
+        delete p;
+        return;
+    }
+    case NODE48: {
+        auto *p = (node48 *)n;
+        for (int i = 0; i < p->count; ++i)
+            freeNode(p->child[i]);
+        delete p;
+        return;
+    }
+    case NODE256: {
+        auto *p = (node256 *)n;
+        for (auto *c : p->child)
+            freeNode(c);
+        delete p;
+        return;
+    }
+    }
+}
+
+radixtree::node **radixtree::findChild(inner *n, uint8_t b) {
+    switch (n->type) {
+    case NODE4: {
+        auto *p = (node4 *)n;
+        for (int i = 0; i < p->count; ++i) {
+            if (p->keys[i] == b)
+                return &p->child[i];
+        }
+        return nullptr;
+    }
+    case NODE16: {
+        auto *p  = (node16 *)n;
+        auto *it = std::lower_bound(p->keys, p->keys + p->count, b);
+        if (it != p->keys + p->count && *it == b)
+            return &p->child[it - p->keys];
+        return nullptr;
+    }
+    case NODE48: {
+        auto *p = (node48 *)n;
+        return p->index[b] ? &p->child[p->index[b] - 1] : nullptr;
+    }
+    case NODE256: {
+        auto *p = (node256 *)n;
+        return p->child[b] ? &p->child[b] : nullptr;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+void radixtree::addChild(node *&ref, uint8_t b, node *child) {
+    switch (ref->type) {
+    case NODE4: {
+        auto *p = (node4 *)ref;
+        if (p->count < 4) {
+            int i = p->count;
+            for (; i > 0 && p->keys[i - 1] > b; --i) { // 保持有序
+                p->keys[i]  = p->keys[i - 1];
+                p->child[i] = p->child[i - 1];
+            }
+            p->keys[i]  = b;
+            p->child[i] = child;
+            p->count++;
+            return;
+        }
+        auto *g = new node16;
+        (inner &)*g = *p; // 复制前缀和子节点数
+        g->type     = NODE16;
+        memcpy(g->keys, p->keys, 4);
+        memcpy(g->child, p->child, 4 * sizeof(node *));
+        delete p;
+        ref = g;
+        addChild(ref, b, child);
+        return;
+    }
+    case NODE16: {
+        auto *p = (node16 *)ref;
+        if (p->count < 16) {
+            int i = p->count;
+            for (; i > 0 && p->keys[i - 1] > b; --i) {
+                p->keys[i]  = p->keys[i - 1];
+                p->child[i] = p->child[i - 1];
+            }
+            p->keys[i]  = b;
+            p->child[i] = child;
+            p->count++;
+            return;
+        }
+        auto *g = new node48;
+        (inner &)*g = *p; // 复制前缀和子节点数
+        g->type     = NODE48;
+        for (int i = 0; i < 16; ++i) {
+            g->index[p->keys[i]] = i + 1;
+            g->child[i]          = p->child[i];
+        }
+        delete p;
+        ref = g;
+        addChild(ref, b, child);
+        return;
+    }
+    case NODE48: {
+        auto *p = (node48 *)ref;
+        if (p->count < 48) { // 不删除条目，下标[0, count)都已占用
+            p->child[p->count] = child;
+            p->index[b]        = ++p->count;
+            return;
+        }
+        auto *g = new node256;
+        (inner &)*g = *p; // 复制前缀和子节点数
+        g->type     = NODE256;
+        for (int i = 0; i < 256; ++i) {
+            if (p->index[i])
+                g->child[i] = p->child[p->index[i] - 1];
+        }
+        delete p;
+        ref = g;
+        addChild(ref, b, child);
+        return;
+    }
+    case NODE256: {
+        auto *p     = (node256 *)ref;
+        p->child[b] = child;
+        p->count++;
+        return;
+    }
+    default:
+        return;
+    }
+}
+
+void radixtree::insert(uint64_t key, const std::string &str) {
+    insert(root, key, str, 0);
+}
+
+void radixtree::insert(node *&ref, uint64_t key, const std::string &str, int depth) {
+    auto newLeaf = [&] {
+        auto *l = new leaf;
+        l->type = LEAF;
+        l->key  = key;
+        l->val  = str;
+        bytes += 12 + str.size(); // key为64位，offset为32位，再加上value的大小
+        return l;
+    };
+    if (!ref) {
+        ref = newLeaf();
+        return;
+    }
+    if (ref->type == LEAF) {
+        auto *l = (leaf *)ref;
+        if (l->key == key) { // 插入的key已存在，则更新值即可
+            bytes = bytes - l->val.size() + str.size();
+            l->val = str;
+            return;
+        }
+        // 两个键从depth起的公共字节成为新节点的前缀，在第一个不同的字节处分叉
+        auto *n = new node4;
+        n->type = NODE4;
+        int d   = depth;
+        for (; byteAt(l->key, d) == byteAt(key, d); ++d)
+            n->prefix[d - depth] = byteAt(key, d);
+        n->prefixLen = d - depth;
+        node *nn     = n;
+        addChild(nn, byteAt(l->key, d), l);
+        addChild(nn, byteAt(key, d), newLeaf());
+        ref = nn;
+        return;
+    }
+    auto *n = (inner *)ref;
+    int p   = 0;
+    while (p < n->prefixLen && n->prefix[p] == byteAt(key, depth + p))
+        p++;
+    if (p < n->prefixLen) {
+        // 前缀在第p个字节处不同：新建一个以前p个字节为前缀的父节点，原节点的前缀去掉前p + 1个字节
+        auto *parent      = new node4;
+        parent->type      = NODE4;
+        parent->prefixLen = p;
+        memcpy(parent->prefix, n->prefix, p);
+        uint8_t old  = n->prefix[p];
+        n->prefixLen = n->prefixLen - p - 1;
+        memmove(n->prefix, n->prefix + p + 1, n->prefixLen);
+        node *pn = parent;
+        addChild(pn, old, n);
+        addChild(pn, byteAt(key, depth + p), newLeaf());
+        ref = pn;
+        return;
+    }
+    depth += n->prefixLen;
+    node **child = findChild(n, byteAt(key, depth));
+    if (child) {
+        insert(*child, key, str, depth + 1);
+        return;
+    }
+    addChild(ref, byteAt(key, depth), newLeaf());
+}
+
+std::string radixtree::search(uint64_t key) {
+    node *n   = root;
+    int depth = 0;
+    while (n) {
+        if (n->type == LEAF) {
+            auto *l = (leaf *)n;
+            return l->key == key ? l->val : "";
+        }
+        // 不比较前缀，叶子中保存完整的键，到叶子时一次比较
+        auto *in = (inner *)n;
+        depth += in->prefixLen;
+        node **child = findChild(in, byteAt(key, depth));
+        if (!child)
+            return "";
+        n = *child;
+        depth++;
+    }
+    return "";
+}
+
+void radixtree::scanNode(node *n, uint64_t base, int depth, uint64_t key1, uint64_t key2,
+                         const std::function<void(uint64_t, const std::string &)> &fn) {
+    if (n->type == LEAF) {
+        auto *l = (leaf *)n;
+        if (l->key >= key1 && l->key <= key2)
+            fn(l->key, l->val);
+        return;
+    }
+    auto *in = (inner *)n;
+    for (int i = 0; i < in->prefixLen; ++i)
+        base |= (uint64_t)in->prefix[i] << (56 - 8 * (depth + i));
+    depth += in->prefixLen;
+    // 子树的键范围为[lo, hi]，与[key1, key2]不相交的子树跳过
+    auto visit = [&](uint8_t b, node *child) {
+        uint64_t lo = base | (uint64_t)b << (56 - 8 * depth);
+        uint64_t hi = lo | (depth == 7 ? 0 : ~0ULL >> (8 * (depth + 1)));
+        if (hi >= key1 && lo <= key2)
+            scanNode(child, lo, depth + 1, key1, key2, fn);
+    };
+    switch (in->type) {
+    case NODE4: {
+        auto *p = (node4 *)in;
+        for (int i = 0; i < p->count; ++i)
+            visit(p->keys[i], p->child[i]);
+        break;
+    }
+    case NODE16: {
+        auto *p = (node16 *)in;
+        for (int i = 0; i < p->count; ++i)
+            visit(p->keys[i], p->child[i]);
+        break;
+    }
+    case NODE48: {
+        auto *p = (node48 *)in;
+        for (int b = 0; b < 256; ++b) {
+            if (p->index[b])
+                visit(b, p->child[p->index[b] - 1]);
+        }
+        break;
+    }
+    case NODE256: {
+        auto *p = (node256 *)in;
+        for (int b = 0; b < 256; ++b) {
+            if (p->child[b])
+                visit(b, p->child[b]);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void radixtree::scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) {
+    if (root)
+        scanNode(root, 0, 0, key1, key2, [&](uint64_t key, const std::string &val) { list.emplace_back(key, val); });
+}
+
+void radixtree::forEach(uint64_t key1, uint64_t key2, const std::function<void(uint64_t, const std::string &)> &fn) {
+    if (root)
+        scanNode(root, 0, 0, key1, key2, fn);
+}
+
+void radixtree::reset() {
+    freeNode(root);
+    root  = nullptr;
+    bytes = 0;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#ifndef LSM_KV_RADIXTREE_H
+#define LSM_KV_RADIXTREE_H
+
+#include "memtable.h"
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief 自适应基数树(Adaptive Radix Tree)实现的memtable
+ *
+ * 键按大端的8个字节逐层分支，内部节点按子节点数在4/16/48/256四种大小之间增长，
+ * 单一路径上的公共字节压缩进节点的prefix，叶子可以挂在任意深度（保存完整的键）。
+ * 一次查找最多8层，每层一次字节比较或下标访问，比跳表的指针跳转少得多的缓存缺失；
+ * 子节点按字节有序，中序遍历即为键的升序
+ */
+class radixtree : public memtable {
+private:
+    enum NodeType : uint8_t {
+        LEAF,
+        NODE4,
+        NODE16,
+        NODE48,
+        NODE256
+    };
+
+    struct node {
+        NodeType type;
+    };
+
+    struct leaf : node {
+        uint64_t key;
+        std::string val;
+    };
+
+    struct inner : node {
+        uint8_t prefixLen = 0; // 本节点之前被压缩的字节数
+        uint16_t count    = 0; // 子节点数
+        uint8_t prefix[8];
+    };
+
+    struct node4 : inner {
+        uint8_t keys[4]; // 有序
+        node *child[4];
+    };
+
+    struct node16 : inner {
+        uint8_t keys[16]; // 有序
+        node *child[16];
+    };
+
+    struct node48 : inner {
+        uint8_t index[256] = {}; // 字节 -> 子节点下标 + 1，0表示没有
+        node *child[48];
+    };
+
+    struct node256 : inner {
+        node *child[256] = {};
+    };
+
+    node *root     = nullptr;
+    uint32_t bytes = 0; // 与跳表相同，12 * 条目数 + 值的总长
+
+    static uint8_t byteAt(uint64_t key, int depth) {
+        return key >> (56 - 8 * depth);
+    }
+
+    static node **findChild(inner *n, uint8_t b);
+    static void addChild(node *&ref, uint8_t b, node *child); // 满时换成更大的节点
+    static void freeNode(node *n);
+    void insert(node *&ref, uint64_t key, const std::string &str, int depth);
+    // 按字节序遍历n，base为n所在子树已确定的高位字节，depth为已确定的字节数
+    static void scanNode(node *n, uint64_t base, int depth, uint64_t key1, uint64_t key2,
+                         const std::function<void(uint64_t, const std::string &)> &fn);
+
+public:
+    radixtree() = default;
+    ~radixtree() override;
+
+    radixtree(const radixtree &)            = delete;
+    radixtree &operator=(const radixtree &) = delete;
+
+    void insert(uint64_t key, const std::string &str) override;
+    std::string search(uint64_t key) override;
+    void scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) override;
+    void reset() override;
+
+    uint32_t getBytes() override {
+        return bytes;
+    }
+
+    bool empty() override {
+        return root == nullptr;
+    }
+
+    using memtable::forEach;
+    void forEach(uint64_t key1, uint64_t key2, const std::function<void(uint64_t, const std::string &)> &fn) override;
+};
+
+#endif // LSM_KV_RADIXTREE_H
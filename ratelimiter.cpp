@@ -0,0 +1,89 @@
+#include "ratelimiter.h"
+
+#include <algorithm>
+
+RateLimiter::RateLimiter(int64_t bytesPerSecond, int64_t refillPeriodMicros) :
+    bytesPerSecond(bytesPerSecond), refillPeriodMicros(std::max<int64_t>(refillPeriodMicros, 1)), autoTune(false),
+    minBytesPerSecond(bytesPerSecond), maxBytesPerSecond(bytesPerSecond), targetLatencyMicros(0) {
+    available  = capacity();
+    lastRefill = Clock::now();
+}
+
+void RateLimiter::enableAutoTune(uint64_t targetLatencyMicros, int64_t minBytesPerSecond, int64_t maxBytesPerSecond) {
+    std::lock_guard<std::mutex> lock(mutex);
+    autoTune                  = true;
+    this->targetLatencyMicros = targetLatencyMicros;
+    this->minBytesPerSecond   = std::max<int64_t>(minBytesPerSecond, 1);
+    this->maxBytesPerSecond   = std::max(maxBytesPerSecond, this->minBytesPerSecond);
+}
+
+void RateLimiter::refill() {
+    Clock::time_point now = Clock::now();
+    double elapsed        = std::chrono::duration<double>(now - lastRefill).count();
+    available             = std::min(capacity(), available + elapsed * bytesPerSecond.load());
+    lastRefill            = now;
+}
+
+void RateLimiter::request(int64_t bytes, IOPriority priority) {
+    if (bytes <= 0)
+        return;
+    std::unique_lock<std::mutex> lock(mutex);
+    totalBytes[(int)priority] += bytes;
+    if (priority == IOPriority::High)
+        highWaiting++;
+    while (bytes > 0) {
+        if (bytesPerSecond.load() <= 0) // 不限速
+            break;
+        // 一次最多取一桶，大请求分段等待
+        double chunk = std::min<double>(bytes, std::max(capacity(), 1.0));
+        refill();
+        if (priority == IOPriority::Low && highWaiting > 0) {
+            cv.wait_for(lock, std::chrono::microseconds(refillPeriodMicros));
+            continue;
+        }
+        if (available >= chunk) {
+            available -= chunk;
+            bytes -= (int64_t)chunk;
+            continue;
+        }
+        // 等到攒够这一段所需的令牌
+        double seconds = (chunk - available) / bytesPerSecond.load();
+        cv.wait_for(lock, std::chrono::duration<double>(seconds));
+    }
+    if (priority == IOPriority::High) {
+        highWaiting--;
+        cv.notify_all();
+    }
+}
+
+void RateLimiter::recordReadLatency(uint64_t micros) {
+    // 每次前台读都会调用，不调节时不能和后台的request争同一把锁
+    if (!autoTune.load(std::memory_order_relaxed))
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    latencyEwma = samples++ ? 0.9 * latencyEwma + 0.1 * micros : micros;
+    // 每32个样本调整一次，避免单次抖动引起速率震荡
+    if (samples % 32)
+        return;
+    int64_t rate = bytesPerSecond.load();
+    if (latencyEwma > targetLatencyMicros)
+        rate = (int64_t)(rate * 0.8);
+    else if (latencyEwma < targetLatencyMicros / 2.0)
+        rate = (int64_t)(rate * 1.05) + 1;
+    bytesPerSecond = std::clamp(rate, minBytesPerSecond, maxBytesPerSecond);
+    available      = std::min(available, capacity());
+    cv.notify_all();
+}
+
+void RateLimiter::setBytesPerSecond(int64_t bytesPerSecond) {
+    std::lock_guard<std::mutex> lock(mutex);
+    refill();
+    this->bytesPerSecond = bytesPerSecond;
+    available            = std::min(available, capacity());
+    cv.notify_all();
+}
+
+double RateLimiter::getReadLatencyEwma() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return latencyEwma;
+}
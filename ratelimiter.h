@@ -0,0 +1,78 @@
+#pragma once
+
+#ifndef LSM_KV_RATELIMITER_H
+#define LSM_KV_RATELIMITER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+enum class IOPriority {
+    Low, // 合并的读写
+    High // memtable落盘，有等待时优先拿到令牌
+};
+
+/**
+ * @brief 后台I/O的令牌桶限速器，多个KVStore可以共享同一个实例
+ *
+ * 令牌按bytesPerSecond匀速生成，桶容量为一个补充周期(refillPeriodMicros)的量，
+ * 超过容量的请求拆成多段依次等待。有High请求在等待时Low请求不取令牌。
+ *
+ * 开启自动调节时，前台读在recordReadLatency中上报每次读盘耗时，按指数滑动平均：
+ * 平均延迟超过targetLatencyMicros时把速率降到0.8倍，低于一半时升到1.05倍，
+ * 速率始终在[minBytesPerSecond, maxBytesPerSecond]之间
+ */
+class RateLimiter {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<int64_t> bytesPerSecond;
+    int64_t refillPeriodMicros;
+    double available = 0; // 桶中剩余的令牌（字节）
+    Clock::time_point lastRefill;
+    int highWaiting = 0; // 正在等待的High请求数
+    std::atomic<uint64_t> totalBytes[2] = {0, 0}; // 按优先级统计已放行的字节数
+
+    // 自动调节
+    std::atomic<bool> autoTune;
+    int64_t minBytesPerSecond, maxBytesPerSecond;
+    uint64_t targetLatencyMicros;
+    double latencyEwma = 0;
+    uint64_t samples   = 0;
+
+    double capacity() const {
+        return (double)bytesPerSecond.load() * refillPeriodMicros / 1e6;
+    }
+
+    void refill(); // 需持有mutex
+
+public:
+    RateLimiter(int64_t bytesPerSecond, int64_t refillPeriodMicros = 100 * 1000);
+
+    // 打开按前台读延迟自动调节速率
+    void enableAutoTune(uint64_t targetLatencyMicros, int64_t minBytesPerSecond, int64_t maxBytesPerSecond);
+
+    // 阻塞直到获得bytes字节的配额
+    void request(int64_t bytes, IOPriority priority);
+
+    // 前台读盘耗时，用于自动调节；未开启自动调节时不加锁直接返回，也不统计平均延迟
+    void recordReadLatency(uint64_t micros);
+
+    void setBytesPerSecond(int64_t bytesPerSecond);
+
+    int64_t getBytesPerSecond() const {
+        return bytesPerSecond.load();
+    }
+
+    uint64_t getTotalBytesThrough(IOPriority priority) const {
+        return totalBytes[(int)priority].load();
+    }
+
+    double getReadLatencyEwma();
+};
+
+#endif // LSM_KV_RATELIMITER_H
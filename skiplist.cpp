@@ -118,4 +118,9 @@ void skiplist::reset() {
 uint32_t skiplist::getBytes() {
     //返回跳表的字节数
     return bytes;
-}
\ No newline at end of file
+}
+
+void skiplist::forEach(uint64_t key1, uint64_t key2, const std::function<void(uint64_t, const std::string &)> &fn) {
+    for (slnode *cur = lowerBound(key1); cur != tail && cur->key <= key2; cur = cur->nxt[0])
+        fn(cur->key, cur->val);
+}
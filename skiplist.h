@@ -1,6 +1,8 @@
 #ifndef LSM_KV_SKIPLIST_H
 #define LSM_KV_SKIPLIST_H
 
+#include "memtable.h"
+
 #include <cstdint>
 #include <limits>
 #include <list>
@@ -31,7 +33,7 @@ public:
     }
 };
 
-class skiplist {
+class skiplist : public memtable {
 private:
     const uint64_t INF = std::numeric_limits<uint64_t>::max();
     double p;
@@ -57,13 +59,20 @@ public:
 
     double my_rand();
     int randLevel();
-    void insert(uint64_t key, const std::string &str);
-    std::string search(uint64_t key);
+    void insert(uint64_t key, const std::string &str) override;
+    std::string search(uint64_t key) override;
     //bool del(uint64_t key, uint32_t len);
-    void scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list);
+    void scan(uint64_t key1, uint64_t key2, std::vector<std::pair<uint64_t, std::string>> &list) override;
     slnode *lowerBound(uint64_t key);
-    void reset();
-    uint32_t getBytes();
+    void reset() override;
+    uint32_t getBytes() override;
+
+    bool empty() override {
+        return head->nxt[0] == tail;
+    }
+
+    using memtable::forEach;
+    void forEach(uint64_t key1, uint64_t key2, const std::function<void(uint64_t, const std::string &)> &fn) override;
 };
 
 #endif // LSM_KV_SKIPLIST_H
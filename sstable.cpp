@@ -14,16 +14,12 @@ void sstable::putFile(const char *path) { // 将内存中的输出到二进制
     FILE *file = fopen(path, "wb");
     fseek(file, 0, SEEK_SET);
     // 4个u64变量
+    uint64_t headCnt = encodeHeadCnt(cnt, filter.getKind());
     fwrite(&time, 8, 1, file);
-    fwrite(&cnt, 8, 1, file);
+    fwrite(&headCnt, 8, 1, file);
     fwrite(&minV, 8, 1, file);
     fwrite(&maxV, 8, 1, file);
-    for (int i = 0; i < 8 * M; i += 8) { // bloom
-        unsigned char cur = 0x0;
-        for (int j = 0; j < 8; ++j)
-            cur |= (filter.getBit(i + j) << j);
-        fwrite(&cur, 1, 1, file);
-    }
+    fwrite(filter.data(), 1, M, file); // bloom
     int size = index.size();
     for (int i = 0; i < size; ++i) { // index
         uint64_t key    = index[i].key;
@@ -61,18 +57,17 @@ void sstable::loadFile(const char *path) { // load file from the path
     FILE *file = fopen(path, "rb+");
     fseek(file, 0, SEEK_SET); // 移动到开头
     reset();
+    uint64_t headCnt = 0;
+    BloomHashKind kind = BloomHashKind::Murmur3;
     fread(&time, 8, 1, file);
-    fread(&cnt, 8, 1, file);
+    fread(&headCnt, 8, 1, file);
+    if (decodeHeadCnt(headCnt, cnt, kind))
+        filter.setKind(kind);
     fread(&minV, 8, 1, file);
     fread(&maxV, 8, 1, file);
-    for (int i = 0; i < 8 * M; i += 8) { // bloom
-        unsigned char cur = 0x0;
-        fread(&cur, 1, 1, file);
-        for (int j = 0; j < 8; ++j) {
-            if ((cur >> j) & 1)
-                filter.setBit(i + j);
-        }
-    }
+    unsigned char bits[M]; // bloom
+    fread(bits, 1, M, file);
+    filter.load(bits);
     bytes = 10240 + 32 + 12 * cnt;
     Index temp;
     for (int i = 0; i < cnt; ++i) { // index
@@ -92,13 +87,17 @@ void sstable::loadFile(const char *path) { // load file from the path
         cur                                        = buf;
         data.push_back(cur);
     }
+    for (auto &it : data) {
+        if (it == DEL)
+            delCnt++;
+    }
     fflush(file);
     fclose(file);
 }
 
 bloom sstable::copyFilter() {
     bloom *res = new bloom;
-    res->setBitset(filter.getBitset());
+    res->load(filter.data());
     return *res;
 }
 
@@ -116,6 +115,7 @@ sstablehead sstable::getHead() {
     res->setMinV(minV);
     res->setMaxV(maxV);
     res->setBytes(bytes);
+    res->setDelCnt(delCnt);
     res->setFilter(filter);
     res->setIndex(index);
     return *res;
@@ -131,6 +131,8 @@ void sstable::insert(uint64_t key, const std::string &val) {
     index.emplace_back(key, curpos);
     filter.insert(key);
     data.push_back(val);
+    if (val == DEL)
+        delCnt++;
 }
 
 bool sstable::checkSize(std::string val, int curLevel, int flag) {
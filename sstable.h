@@ -6,10 +6,11 @@
 #include "skiplist.h"
 #include "sstablehead.h"
 
+#include <atomic>
 #include <cstdint>
 #include <vector>
 #include <limits>
-static uint64_t TIME = 0;                     // 全局时间戳
+inline std::atomic<uint64_t> TIME{0};         // 全局时间戳，flush与后台合并线程共享
 const uint64_t INF   = std::numeric_limits<uint64_t>::max();
 
 class sstable : public sstablehead { // 储存sstable的软数据结构
@@ -23,6 +24,7 @@ public:
         minV   = INF;
         maxV   = 0;
         bytes  = 10240 + 32;
+        delCnt = 0;
         filter.reset();
         index.clear();
         data.clear();
@@ -40,12 +42,13 @@ public:
         data.clear();
     }
 
-    sstable(skiplist *s) { // 将一个memtable转成sstable， 这里时间戳加1
+    sstable(skiplist *s, BloomHashKind bloomHash = BloomHashKind::Murmur3) { // 将一个memtable转成sstable， 这里时间戳加1
         reset();
+        filter.setKind(bloomHash);
         curpos      = 0;
         bytes       = 10240 + 32 + s->getBytes();
         time        = ++TIME;
-        filename    = "./data/level-0/" + std::to_string(TIME) + ".sst"; // 初始的文件名就是时间戳
+        filename    = "./data/level-0/" + std::to_string(time) + ".sst"; // 初始的文件名就是时间戳
         cnt         = 0;
         minV        = INF;
         maxV        = 0;
@@ -58,6 +61,8 @@ public:
             filter.insert(cur->key);
             index.emplace_back(cur->key, curpos);
             data.push_back(cur->val);
+            if (cur->val == DEL)
+                delCnt++;
             cur = cur->nxt[0];
         }
     }
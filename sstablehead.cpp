@@ -1,11 +1,14 @@
 #include "sstablehead.h"
 
+#include "metacache.h"
+
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 
 void sstablehead::loadFileHead(const char *path) { // 只读取文件头
-    FILE *file = fopen(path, "rb+");               // 注意格式为二进制
-    filename   = path;
+    filename = path;
+    cacheId  = 0; // 换成另一张表，在partition时重新分配表号
     int len = std::strlen(path), c = 0;
     std::string suf;
     for (int i = 0; i < len; ++i) {
@@ -21,31 +24,115 @@ void sstablehead::loadFileHead(const char *path) { // 只读取文件头
         nameSuffix = std::stoi(suf);
     else
         nameSuffix = 0;
-    fseek(file, 0, SEEK_SET);
+    FILE *file = fopen(path, "rb"); // 注意格式为二进制
+    if (!file) {
+        std::cout << "open " << filename << " fail!" << std::endl;
+        return;
+    }
     reset();
 
+    uint64_t headCnt = 0;
+    BloomHashKind kind = BloomHashKind::Murmur3;
     fread(&time, 8, 1, file);
-    fread(&cnt, 8, 1, file);
+    fread(&headCnt, 8, 1, file);
     fread(&minV, 8, 1, file);
     fread(&maxV, 8, 1, file);
-    for (int i = 0; i < M * 8; i += 8) { // bloom
-        unsigned char cur = 0x0;
-        fread(&cur, 1, 1, file);
-        for (int j = 0; j < 8; ++j) {
-            if ((cur >> j) & 1)
-                filter.setBit(i + j);
+    fclose(file);
+    bool recorded = decodeHeadCnt(headCnt, cnt, kind);
+    loadFilterAndIndex();
+    bytes = 10240 + 32 + 12 * cnt + getOffset(cnt - 1);
+    filter.setKind(kind);
+    if (!recorded) {
+        // 旧文件没有记录bloom的哈希函数：表中的键在正确的函数下必然命中，抽查若干键即可判断
+        for (uint64_t i = 0; i < cnt; i += std::max<uint64_t>(1, cnt / 16)) {
+            if (!filter.search(index[i].key)) {
+                filter.setKind(BloomHashKind::Mix64);
+                break;
+            }
         }
     }
-    Index temp;
-    bytes = 10240 + 32 + 12 * cnt;
-    for (int i = 0; i < cnt; ++i) { // index
-        fread(&temp.key, 8, 1, file);
-        fread(&temp.offset, 4, 1, file);
-        index.push_back(temp);
+    // 文件头中没有删除标记条数，按值长度等于删除标记长度的条目数估计
+    delCnt = 0;
+    for (int i = 0; i < cnt; ++i) {
+        if (getOffset(i) - getOffset(i - 1) == DEL.size())
+            delCnt++;
+    }
+}
+
+void sstablehead::loadMeta(const std::string &filename, uint64_t time, uint64_t cnt, uint64_t minV, uint64_t maxV,
+                           uint32_t bytes, uint64_t delCnt, BloomHashKind bloomHash) {
+    reset();
+    cacheId        = 0;
+    this->filename = filename;
+    this->time     = time;
+    this->cnt      = cnt;
+    this->minV     = minV;
+    this->maxV     = maxV;
+    this->bytes    = bytes;
+    this->delCnt   = delCnt;
+    filter.setKind(bloomHash);
+    loaded         = false;
+}
+
+void sstablehead::loadFilterAndIndex() {
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (!file) {
+        std::cout << "open " << filename << " fail!" << std::endl;
+        return;
+    }
+    if (cache) {
+        // 分区模式只需要每个分区的第一个键，读完整个索引区后只留下fences
+        std::vector<unsigned char> buf(12 * cnt);
+        fseek(file, 32 + M, SEEK_SET);
+        fread(buf.data(), 1, buf.size(), file);
+        fclose(file);
+        index.clear();
+        fences.clear();
+        for (uint64_t i = 0; i < cnt; i += INDEX_PARTITION) {
+            uint64_t key;
+            memcpy(&key, buf.data() + 12 * i, 8);
+            fences.push_back(key);
+        }
+        loaded = true;
+        return;
     }
-    bytes += temp.offset;
-    fflush(file);
+    // 跳过32字节头，bloom和索引连续存放，一次读入
+    std::vector<unsigned char> buf(M + 12 * cnt);
+    fseek(file, 32, SEEK_SET);
+    fread(buf.data(), 1, buf.size(), file);
     fclose(file);
+    filter.load(buf.data()); // bloom
+    index.resize(cnt);
+    for (uint64_t i = 0; i < cnt; ++i) { // index
+        memcpy(&index[i].key, buf.data() + M + 12 * i, 8);
+        memcpy(&index[i].offset, buf.data() + M + 12 * i + 8, 4);
+    }
+    loaded = true;
+}
+
+void sstablehead::fitFilter(uint32_t size) {
+    if (cache) { // 过滤器不常驻，换掉cache中的旧大小即可
+        if (size != filterBytes) {
+            filterBytes = size;
+            cache->erase(cacheId, MetaCache::FILTER_BLOCK);
+        }
+        return;
+    }
+    if (!loaded || size == filter.size())
+        return;
+    if (size && (size > filter.size() || filter.size() % size)) {
+        FILE *file = fopen(filename.c_str(), "rb");
+        if (!file) {
+            std::cout << "open " << filename << " fail!" << std::endl;
+            return;
+        }
+        std::vector<unsigned char> buf(M);
+        fseek(file, 32, SEEK_SET);
+        fread(buf.data(), 1, M, file);
+        fclose(file);
+        filter.load(buf.data());
+    }
+    filter.fold(size);
 }
 
 void sstablehead::reset() {
@@ -53,38 +140,134 @@ void sstablehead::reset() {
     index.clear();
 }
 
+void sstablehead::partition(MetaCache *cache) {
+    if (cache && (this->cache != cache || !cacheId))
+        cacheId = cache->newId();
+    this->cache = cache;
+    if (!loaded)
+        return;
+    fences.clear();
+    for (uint64_t i = 0; i < cnt; i += INDEX_PARTITION)
+        fences.push_back(index[i].key);
+    filterBytes = filter.size();
+    index.clear();
+    index.shrink_to_fit();
+    filter.fold(0);
+}
+
+void sstablehead::makeResident() {
+    if (!cache)
+        return;
+    uint32_t size = filterBytes;
+    cache         = nullptr;
+    fences.clear();
+    loadFilterAndIndex();
+    filter.fold(size);
+}
+
+void sstablehead::dropCached() {
+    if (!cache)
+        return;
+    for (uint64_t p = 0; p * INDEX_PARTITION < cnt; ++p)
+        cache->erase(cacheId, p);
+    cache->erase(cacheId, MetaCache::FILTER_BLOCK);
+}
+
+std::shared_ptr<const std::vector<Index>> sstablehead::indexPartition(uint32_t p) const {
+    auto cached = std::static_pointer_cast<const std::vector<Index>>(cache->lookup(cacheId, p));
+    if (cached)
+        return cached;
+    uint64_t start = (uint64_t)p * INDEX_PARTITION, n = std::min<uint64_t>(INDEX_PARTITION, cnt - start);
+    std::vector<unsigned char> buf(12 * n);
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (file) {
+        fseek(file, 32 + M + 12 * start, SEEK_SET);
+        fread(buf.data(), 1, buf.size(), file);
+        fclose(file);
+    } else
+        std::cout << "open " << filename << " fail!" << std::endl;
+    auto part = std::make_shared<std::vector<Index>>(n);
+    for (uint64_t i = 0; i < n; ++i) {
+        memcpy(&(*part)[i].key, buf.data() + 12 * i, 8);
+        memcpy(&(*part)[i].offset, buf.data() + 12 * i + 8, 4);
+    }
+    cache->insert(cacheId, p, part, sizeof(Index) * n);
+    return part;
+}
+
+std::shared_ptr<const bloom> sstablehead::filterBlock() const {
+    auto cached = std::static_pointer_cast<const bloom>(cache->lookup(cacheId, MetaCache::FILTER_BLOCK));
+    if (cached)
+        return cached;
+    std::vector<unsigned char> buf(M);
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (file) {
+        fseek(file, 32, SEEK_SET);
+        fread(buf.data(), 1, M, file);
+        fclose(file);
+    } else
+        std::cout << "open " << filename << " fail!" << std::endl;
+    auto block = std::make_shared<bloom>(filter); // 复制哈希函数
+    block->load(buf.data());
+    block->fold(filterBytes);
+    cache->insert(cacheId, MetaCache::FILTER_BLOCK, block, filterBytes);
+    return block;
+}
+
+Index sstablehead::indexAt(int p) const {
+    if (!cache)
+        return index[p];
+    return (*indexPartition(p / INDEX_PARTITION))[p % INDEX_PARTITION];
+}
+
+bool sstablehead::mayContain(bloomProbe &probe) const {
+    if (!cache)
+        return filter.search(probe);
+    if (!filterBytes)
+        return true;
+    return filterBlock()->search(probe);
+}
+
 int sstablehead::search(uint64_t key) {
-    int res = filter.search(key);
-    if (!res)
+    bloomProbe probe(key);
+    if (!mayContain(probe))
         return -1; // bloom 说没有 确实没有
-    auto it = std::lower_bound(index.begin(), index.end(), Index(key, 0));
-    if (it == index.end())
-        return -1; // 没找到
-    if ((*it).key == key)
-        return it - index.begin(); // 在这一块二分找到了，返回第几个字符串
+    int p = lowerBound(key);
+    if (p < (int)cnt && indexAt(p).key == key)
+        return p; // 二分找到了，返回第几个字符串
     return -1;
 }
 
 int sstablehead::searchOffset(uint64_t key, uint32_t &len) {
-    int res = filter.search(key);
-    if (!res)
+    bloomProbe probe(key);
+    return searchOffset(probe, len);
+}
+
+int sstablehead::searchOffset(bloomProbe &probe, uint32_t &len) {
+    uint64_t key = probe.getKey();
+    if (!mayContain(probe))
         return -1; // bloom 说没有 确实没有
-    auto it = std::lower_bound(index.begin(), index.end(), Index(key, 0));
-    if (it == index.end())
+    int p = lowerBound(key);
+    if (p >= (int)cnt)
         return -1; // 没找到
-    if ((*it).key == key) {
-        if (it == index.begin()) {
-            len = (*it).offset;
-            return 0;
-        } else {
-            len = (*it).offset - (*(it - 1)).offset;
-            return (*(it - 1)).offset;
-        }
-    }
-    return -1;
+    Index cur = indexAt(p);
+    if (cur.key != key)
+        return -1;
+    uint32_t start = getOffset(p - 1);
+    len            = cur.offset - start;
+    return start;
 }
 
 int sstablehead::lowerBound(uint64_t key) {
-    auto it = std::lower_bound(index.begin(), index.end(), Index(key, 0));
-    return it - index.begin(); // found
+    if (!cache) {
+        auto it = std::lower_bound(index.begin(), index.end(), Index(key, 0));
+        return it - index.begin(); // found
+    }
+    // 先在fences中找到key所在的分区，再在分区内二分
+    int q = std::upper_bound(fences.begin(), fences.end(), key) - fences.begin() - 1;
+    if (q < 0)
+        return 0;
+    auto part = indexPartition(q);
+    auto it   = std::lower_bound(part->begin(), part->end(), Index(key, 0));
+    return q * INDEX_PARTITION + (it - part->begin());
 }
@@ -5,8 +5,29 @@
 #include "bloom.h"
 
 #include <cstdint>
-#include <vector>
 #include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+class MetaCache;
+
+inline const std::string DEL = "~DELETED~"; // 删除标记
+
+// 文件头cnt字段的最高字节记录bloom的哈希函数：最高位为1表示已记录，低7位是BloomHashKind。
+// 旧文件这一字节为0，读取时退回抽查键来判断
+inline uint64_t encodeHeadCnt(uint64_t cnt, BloomHashKind kind) {
+    return cnt | (uint64_t)(0x80 | (uint8_t)kind) << 56;
+}
+
+// 拆出条目数，返回文件头中是否记录了哈希函数
+inline bool decodeHeadCnt(uint64_t field, uint64_t &cnt, BloomHashKind &kind) {
+    cnt = field & ((1ull << 56) - 1);
+    if (!(field >> 63))
+        return false;
+    kind = (BloomHashKind)((field >> 56) & 0x7f);
+    return true;
+}
 
 struct Index {
     uint64_t key;
@@ -31,10 +52,26 @@ protected:
     uint32_t bytes;          // 理论上的sstable转换成文件的大小
     uint32_t curpos;         // 当前offset的位置
     uint32_t nameSuffix = 0; // 区分同一时间戳，不同文件的姓名后缀
+    uint64_t delCnt     = 0; // 删除标记条数；从文件头加载时按值长度估计（上界）
+    bool loaded         = true; // bloom和索引是否已在内存中；由清单恢复的表首次访问时才从文件读入
     bloom filter;
     std::vector<Index> index;
 
+    // 分区模式：cache非空时索引按INDEX_PARTITION条分区、连同过滤器按需经cache读入，
+    // 常驻内存的只有每个分区的第一个键fences（顶层索引）
+    MetaCache *cache = nullptr;
+    uint64_t cacheId = 0; // cache分配的表号，复制表头时随之复制，改名（平凡移动）不变
+    std::vector<uint64_t> fences;
+    uint32_t filterBytes = M; // 分区模式下过滤器折叠后的字节数，0表示不用过滤器
+
+    std::shared_ptr<const std::vector<Index>> indexPartition(uint32_t p) const;
+    std::shared_ptr<const bloom> filterBlock() const;
+    Index indexAt(int p) const;
+    bool mayContain(bloomProbe &probe) const;
+
 public:
+    static constexpr uint32_t INDEX_PARTITION = 128; // 每个索引分区的条目数
+
     bool operator<(const sstablehead &other) const {
         if (time == other.time)
             return minV < other.minV;
@@ -51,8 +88,39 @@ public:
     }
 
     void loadFileHead(const char *path);
+    // 只设置元数据，bloom和索引留到loadFilterAndIndex时再读
+    void loadMeta(const std::string &filename, uint64_t time, uint64_t cnt, uint64_t minV, uint64_t maxV,
+                  uint32_t bytes, uint64_t delCnt, BloomHashKind bloomHash);
+    void loadFilterAndIndex(); // 一次读入bloom和索引
     void reset();
 
+    bool isLoaded() const {
+        return loaded;
+    }
+
+    // 内存中的过滤器改为size字节，需要更大的过滤器时从文件重读完整的再折叠；未读入的表不处理
+    void fitFilter(uint32_t size);
+
+    uint32_t getFilterSize() const {
+        return cache ? filterBytes : filter.size();
+    }
+
+    // 转为分区模式：之后索引和过滤器经cache按需读入，常驻的只有fences；未读入的表在读入时只建fences
+    void partition(MetaCache *cache);
+    // 分区模式的表读入完整的索引和过滤器并脱离cache，用于合并时的私有副本顺序读全部索引
+    void makeResident();
+    // 从cache中删除这张表的全部分区和过滤器，在表被删除时调用
+    void dropCached();
+
+    bool isPartitioned() const {
+        return cache;
+    }
+
+    void ensureLoaded() {
+        if (!loaded)
+            loadFilterAndIndex();
+    }
+
     void setFilename(std::string filename) {
         this->filename = filename;
     }
@@ -81,8 +149,20 @@ public:
         this->bytes = bytes;
     }
 
+    void setDelCnt(uint64_t delCnt) {
+        this->delCnt = delCnt;
+    }
+
+    BloomHashKind getBloomHash() const {
+        return filter.getKind();
+    }
+
+    void setBloomHash(BloomHashKind kind) {
+        filter.setKind(kind);
+    }
+
     void setFilter(bloom filter) {
-        this->filter.setBitset(filter.getBitset());
+        this->filter = filter;
     }
 
     void setIndex(std::vector<Index> index) {
@@ -110,26 +190,38 @@ public:
     }
 
     uint64_t getKey(int p) {
-        return index[p].key;
+        return cache ? indexAt(p).key : index[p].key;
     }
 
     uint32_t getBytes() const {
         return bytes;
     }
 
+    uint64_t getDelCnt() const {
+        return delCnt;
+    }
+
+    // 删除标记所占比例，用于合并选表时优先回收空间
+    double delDensity() const {
+        return cnt ? (double)delCnt / cnt : 0;
+    }
+
     uint32_t getNameSuf() const {
         return nameSuffix;
     }
 
     uint32_t getOffset(int p) {
-        return (p < 0) ? 0 : index[p].offset;
+        if (p < 0)
+            return 0;
+        return cache ? indexAt(p).offset : index[p].offset;
     }
 
     Index getIndexById(int p) {
-        return index[p];
+        return cache ? indexAt(p) : index[p];
     }
 
     int searchOffset(uint64_t key, uint32_t &len);
+    int searchOffset(bloomProbe &probe, uint32_t &len); // 一次查找的各表共用probe中的哈希值
 
     int search(uint64_t key);
     int lowerBound(uint64_t key); /*返回大于等于的第一个的下标 没有返回len + 1*/
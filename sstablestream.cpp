@@ -0,0 +1,205 @@
+#include "sstablestream.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+sstablereader::sstablereader(sstablehead *head, int begin, int end, size_t bufSize, RateLimiter *limiter) :
+    head(head), pos(begin), end(end), bufSize(bufSize), limiter(limiter) {
+    dataBase = 32 + 10240 + 12 * head->getCnt();
+    if (pos < end) {
+        file = fopen(head->getFilename().c_str(), "rb");
+        if (!file)
+            throw std::runtime_error("Failed to open file: " + head->getFilename());
+    }
+}
+
+sstablereader::~sstablereader() {
+    if (file)
+        fclose(file);
+}
+
+void sstablereader::load(uint64_t offset, uint32_t len) {
+    if (offset >= bufStart && offset + len <= bufStart + bufLen)
+        return;
+    // 从offset开始读一整块，但不越过本读取器范围内最后一条数据的末尾
+    uint64_t rangeEnd = head->getOffset(end - 1);
+    size_t want       = std::max<size_t>(len, std::min<uint64_t>(bufSize, rangeEnd - offset));
+    if (buf.size() < want)
+        buf.resize(want);
+    if (limiter)
+        limiter->request(want, IOPriority::Low);
+    fseek(file, dataBase + offset, SEEK_SET);
+    bufLen   = fread(buf.data(), 1, want, file);
+    bufStart = offset;
+    if (bufLen < len)
+        throw std::runtime_error("Short read from file: " + head->getFilename());
+}
+
+std::string_view sstablereader::value() {
+    uint64_t start = head->getOffset(pos - 1);
+    uint32_t len   = head->getOffset(pos) - start;
+    load(start, len);
+    return std::string_view(buf.data() + (start - bufStart), len);
+}
+
+sstablewriter::sstablewriter(const std::string &filename, uint64_t time, RateLimiter *limiter, size_t bufSize) :
+    bufSize(std::max<size_t>(4096, bufSize)), limiter(limiter) {
+    this->filename = filename;
+    this->time     = time;
+    data.reserve(this->bufSize);
+}
+
+sstablewriter::~sstablewriter() {
+    // finish()之前因异常放弃的表：删掉暂存文件
+    if (spill) {
+        fclose(spill);
+        utils::rmfile((filename + SPILL_SUFFIX).c_str());
+    }
+}
+
+void sstablewriter::spillData() {
+    std::string spillName = filename + SPILL_SUFFIX;
+    if (!spill) {
+        spill = fopen(spillName.c_str(), "wb+");
+        if (!spill)
+            throw std::runtime_error("Failed to open file: " + spillName);
+    }
+    if (limiter)
+        limiter->request(data.size(), IOPriority::Low);
+    if (fwrite(data.data(), 1, data.size(), spill) != data.size())
+        throw std::runtime_error("Failed to write file: " + spillName);
+    data.clear();
+}
+
+void sstablewriter::add(uint64_t key, std::string_view val) {
+    cnt++;
+    curpos += val.length();
+    minV = std::min(minV, key);
+    maxV = std::max(maxV, key);
+    bytes += 12 + val.length();
+    index.emplace_back(key, curpos);
+    filter.insert(key);
+    data.append(val);
+    if (val == DEL)
+        delCnt++;
+    if (data.size() >= bufSize)
+        spillData();
+}
+
+sstablehead sstablewriter::finish() {
+    // 头部、bloom和索引先拼成一块写出，数据区紧随其后
+    std::string head;
+    head.reserve(32 + 10240 + 12 * cnt);
+    head.append((const char *)&time, 8);
+    uint64_t headCnt = encodeHeadCnt(cnt, filter.getKind());
+    head.append((const char *)&headCnt, 8);
+    head.append((const char *)&minV, 8);
+    head.append((const char *)&maxV, 8);
+    head.append((const char *)filter.data(), M); // bloom
+    for (auto &it : index) { // index
+        head.append((const char *)&it.key, 8);
+        head.append((const char *)&it.offset, 4);
+    }
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("Failed to open file: " + filename);
+    if (limiter)
+        limiter->request(head.size(), IOPriority::Low);
+    bool ok = fwrite(head.data(), 1, head.size(), file) == head.size();
+    if (spill) {
+        // 暂存文件刚写过，按块读回时多在页缓存中；复用一个缓冲区大小的内存
+        std::vector<char> buf(bufSize);
+        ok = ok && fflush(spill) == 0 && fseek(spill, 0, SEEK_SET) == 0;
+        size_t n;
+        while (ok && (n = fread(buf.data(), 1, buf.size(), spill)) > 0) {
+            if (limiter)
+                limiter->request(n, IOPriority::Low);
+            ok = fwrite(buf.data(), 1, n, file) == n;
+        }
+        ok = ok && !ferror(spill);
+        fclose(spill);
+        spill = nullptr;
+        utils::rmfile((filename + SPILL_SUFFIX).c_str());
+    }
+    if (limiter)
+        limiter->request(data.size(), IOPriority::Low);
+    ok = ok && fwrite(data.data(), 1, data.size(), file) == data.size();
+    // 合并安装后会删除输入表，输出必须先落到磁盘上
+    ok = ok && utils::syncfile(file) == 0;
+    fclose(file);
+    if (!ok) {
+        utils::rmfile(filename.c_str());
+        throw std::runtime_error("Failed to write file: " + filename);
+    }
+    return *this;
+}
+
+memtablewriter::memtablewriter(memtable *mem, const std::string &filename, uint64_t time, BloomHashKind bloomHash,
+                               size_t bufSize, RateLimiter *limiter, uint64_t key1, uint64_t key2) :
+    mem(mem), bufSize(std::max<size_t>(4096, bufSize / 4096 * 4096)), limiter(limiter), key1(key1), key2(key2) {
+    this->filename = filename;
+    this->time     = time;
+    filter.setKind(bloomHash);
+    mem->forEach(key1, key2, [&](uint64_t key, const std::string &val) {
+        cnt++;
+        curpos += val.length();
+        minV = std::min(minV, key);
+        maxV = std::max(maxV, key);
+        bytes += 12 + val.length();
+        index.emplace_back(key, curpos);
+        filter.insert(key);
+        if (val == DEL)
+            delCnt++;
+    });
+}
+
+sstablehead memtablewriter::finish() {
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file)
+        throw std::runtime_error("Failed to open file: " + filename);
+    setvbuf(file, nullptr, _IONBF, 0); // 已经按整块写，不再经过stdio的缓冲区
+    std::vector<char> buf(bufSize);
+    size_t used = 0;
+    bool ok     = true; // 写满磁盘等短写之后不再写，最后删除残缺的文件
+    auto flush  = [&] {
+        if (limiter)
+            limiter->request(used, IOPriority::High);
+        ok   = ok && fwrite(buf.data(), 1, used, file) == used;
+        used = 0;
+    };
+    auto append = [&](const void *src, size_t len) {
+        const char *p = (const char *)src;
+        while (len) {
+            size_t n = std::min(len, bufSize - used);
+            memcpy(buf.data() + used, p, n);
+            used += n;
+            p += n;
+            len -= n;
+            if (used == bufSize)
+                flush();
+        }
+    };
+    append(&time, 8);
+    uint64_t headCnt = encodeHeadCnt(cnt, filter.getKind());
+    append(&headCnt, 8);
+    append(&minV, 8);
+    append(&maxV, 8);
+    append(filter.data(), M); // bloom
+    for (auto &it : index) { // index
+        append(&it.key, 8);
+        append(&it.offset, 4);
+    }
+    mem->forEach(key1, key2, [&](uint64_t, const std::string &val) { append(val.data(), val.length()); });
+    if (used)
+        flush();
+    ok = ok && utils::syncfile(file) == 0;
+    fclose(file);
+    if (!ok) {
+        utils::rmfile(filename.c_str());
+        throw std::runtime_error("Failed to write file: " + filename);
+    }
+    return *this;
+}
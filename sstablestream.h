@@ -0,0 +1,122 @@
+#pragma once
+
+#ifndef LSM_KV_SSTABLESTREAM_H
+#define LSM_KV_SSTABLESTREAM_H
+#include "ratelimiter.h"
+#include "memtable.h"
+#include "sstablehead.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief 顺序读取一个SSTable中[begin, end)号条目的流式读取器
+ *
+ * 键和偏移取自已缓存的表头索引，数据区按大块顺序读入一个复用的缓冲区，
+ * value()返回指向缓冲区的视图，在下一次next()之前有效。内存占用约为一个缓冲区大小。
+ * limiter非空时每次读盘前按低优先级申请配额
+ */
+class sstablereader {
+private:
+    sstablehead *head;
+    FILE *file = nullptr;
+    int pos, end;
+    uint64_t dataBase;     // 数据区在文件中的起始偏移
+    uint64_t bufStart = 0; // buf[0]对应的数据区偏移
+    size_t bufLen     = 0;
+    size_t bufSize;
+    std::vector<char> buf;
+    RateLimiter *limiter;
+
+    void load(uint64_t offset, uint32_t len); // 保证数据区[offset, offset + len)在缓冲区内
+
+public:
+    sstablereader(sstablehead *head, int begin, int end, size_t bufSize, RateLimiter *limiter = nullptr);
+    ~sstablereader();
+
+    sstablereader(const sstablereader &)            = delete;
+    sstablereader &operator=(const sstablereader &) = delete;
+
+    bool valid() const {
+        return pos < end;
+    }
+
+    uint64_t key() {
+        return head->getKey(pos);
+    }
+
+    uint64_t getTime() const {
+        return head->getTime();
+    }
+
+    std::string_view value();
+
+    void next() {
+        pos++;
+    }
+};
+
+/**
+ * @brief 增量构建一个SSTable：逐条追加键值，bloom与索引随写随建，数据先攒在bufSize字节的写缓冲区中。
+ *
+ * 文件中索引在数据区之前、长度取决于最终的条目数，写完之前数据区的位置未知：缓冲区写满时
+ * 整块追加到暂存文件（文件名加SPILL_SUFFIX），finish()时先写头部、bloom和索引，再按块把暂存的数据
+ * 和缓冲区中剩下的数据接在后面。峰值内存为索引加一个缓冲区，与输出表大小无关；
+ * 整个表不超过一个缓冲区时不经过暂存文件。limiter非空时每次写盘前按低优先级申请配额
+ */
+class sstablewriter : public sstablehead {
+private:
+    std::string data; // 写缓冲区中尚未写出的数据
+    size_t bufSize;
+    FILE *spill = nullptr; // 暂存已写出的数据，第一次写满缓冲区时创建
+    RateLimiter *limiter;
+
+    void spillData(); // 把缓冲区追加到暂存文件
+
+public:
+    static constexpr const char *SPILL_SUFFIX = ".spill";
+
+    sstablewriter(const std::string &filename, uint64_t time, RateLimiter *limiter = nullptr,
+                  size_t bufSize = 1 << 20);
+    ~sstablewriter();
+
+    sstablewriter(const sstablewriter &)            = delete;
+    sstablewriter &operator=(const sstablewriter &) = delete;
+
+    // 追加一个长度为len的值后是否仍不超过maxBytes；空表总能放下一条
+    bool fits(size_t len, uint32_t maxBytes) const {
+        return cnt == 0 || bytes + 12 + len <= maxBytes;
+    }
+
+    void add(uint64_t key, std::string_view val);
+
+    sstablehead finish(); // 写盘并返回表头
+};
+
+/**
+ * @brief 把memtable流式写成一个SSTable，不复制memtable中的值
+ *
+ * 构造时按键顺序扫一遍memtable，建立bloom和索引（文件中它们在数据区之前）；finish()再扫一遍，
+ * 把头部、bloom、索引和值依次拷进一块bufSize字节（4KB的整数倍）的写缓冲区，满一块写一次，
+ * 最后fdatasync一次。峰值内存为索引加一个缓冲区。finish()返回前memtable不能修改。
+ * limiter非空时每次写盘前按高优先级申请配额。只写键在[key1, key2]内的条目，没有时getCnt()为0，不要调用finish()
+ */
+class memtablewriter : public sstablehead {
+private:
+    memtable *mem;
+    size_t bufSize;
+    RateLimiter *limiter;
+    uint64_t key1, key2;
+
+public:
+    memtablewriter(memtable *mem, const std::string &filename, uint64_t time, BloomHashKind bloomHash,
+                   size_t bufSize = 1 << 20, RateLimiter *limiter = nullptr, uint64_t key1 = 0,
+                   uint64_t key2 = UINT64_MAX);
+
+    sstablehead finish(); // 写盘并返回表头
+};
+
+#endif // LSM_KV_SSTABLESTREAM_H
@@ -0,0 +1,129 @@
+#include "../kvstore.h"
+#include "../bloom.h"
+#include <iostream>
+#include <map>
+#include <string>
+
+// 折叠后的过滤器对插入过的键不能漏报，假阳性率随大小变小而升高
+bool check_fold() {
+  bool pass = true;
+  bloom full;
+  for (uint64_t key = 0; key < 3000; key++)
+    full.insert(key * 13);
+  double lastRate = -1;
+  for (uint32_t size : {10240u, 2560u, 640u, 160u}) {
+    bloom folded = full;
+    folded.fold(size);
+    for (uint64_t key = 0; key < 3000; key++) {
+      if (!folded.search(key * 13)) {
+        std::cout << "[fold] Error: key " << key * 13 << " missing after folding to " << size << std::endl;
+        return false;
+      }
+    }
+    int positives = 0;
+    for (uint64_t key = 0; key < 100000; key++)
+      positives += folded.search(key * 13 + 1);
+    double rate = positives / 100000.0;
+    std::cout << "[fold] " << size << " bytes false positive rate: " << rate << std::endl;
+    if (rate < lastRate) {
+      std::cout << "[fold] Error: smaller filter has lower false positive rate" << std::endl;
+      pass = false;
+    }
+    lastRate = rate;
+  }
+  return pass;
+}
+
+// Monkey分配：总位数不超预算，条目多的层每键位数少
+bool check_allocate() {
+  std::vector<uint64_t> entries{1000, 10000, 100000};
+  std::vector<double> maxBits{100, 100, 100};
+  double budget = 8 * 111000.0;
+  std::vector<double> bits = allocateBloomBits(entries, maxBits, budget);
+  double total = 0;
+  for (size_t i = 0; i < entries.size(); i++)
+    total += bits[i] * entries[i];
+  std::cout << "[allocate] bits per key: " << bits[0] << " " << bits[1] << " " << bits[2] << std::endl;
+  if (total > budget * 1.001 || !(bits[0] > bits[1] && bits[1] > bits[2])) {
+    std::cout << "[allocate] Error: bad allocation" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// 各种过滤器配置下get的结果不变，并且过滤器内存小于默认配置
+bool check_store(const KVStoreOptions &options, const std::string &name, uint64_t fullMemory) {
+  bool pass = true;
+  std::map<uint64_t, std::string> expect;
+  int total = 12000;
+  uint64_t memory;
+  {
+    KVStore store("data/", options);
+    store.reset();
+    for (int i = 0; i < total; i++) {
+      uint64_t key = (i * 7919ull) % (2 * total + 1);
+      std::string value(1000 + (i * 37) % 1000, 'a' + i % 26);
+      store.put(key, value);
+      expect[key] = value;
+    }
+    for (uint64_t key = 0; key <= 2 * total; key++) {
+      std::string want = expect.count(key) ? expect[key] : "";
+      if (store.get(key) != want) {
+        std::cout << "[" << name << "] Error: get(" << key << ") mismatch" << std::endl;
+        pass = false;
+        break;
+      }
+    }
+    memory = store.filterMemory();
+    std::cout << "[" << name << "] filter memory: " << memory << " bytes" << std::endl;
+  }
+  if (fullMemory && memory >= fullMemory) {
+    std::cout << "[" << name << "] Error: filters not smaller than default" << std::endl;
+    pass = false;
+  }
+  if (options.bloomMemoryBudget && memory > options.bloomMemoryBudget) {
+    std::cout << "[" << name << "] Error: filters exceed memory budget" << std::endl;
+    pass = false;
+  }
+  {
+    KVStore store("data/", options);
+    for (uint64_t key = 0; key <= 2 * total; key += 7) {
+      std::string want = expect.count(key) ? expect[key] : "";
+      if (store.get(key) != want) {
+        std::cout << "[" << name << "] Error: get(" << key << ") mismatch after reopen" << std::endl;
+        pass = false;
+        break;
+      }
+    }
+  }
+  return pass;
+}
+
+int main() {
+  bool pass = true;
+  pass &= check_fold();
+  pass &= check_allocate();
+
+  KVStoreOptions default_options;
+  pass &= check_store(default_options, "default", 0);
+  KVStore *probe = new KVStore("data/", default_options);
+  uint64_t fullMemory = probe->filterMemory();
+  delete probe;
+
+  KVStoreOptions per_level_options;
+  per_level_options.bloomBitsPerKey = {20, 10, 5};
+  pass &= check_store(per_level_options, "per-level", fullMemory);
+
+  KVStoreOptions skip_last_options;
+  skip_last_options.bloomSkipLastLevel = true;
+  pass &= check_store(skip_last_options, "skip-last-level", fullMemory);
+
+  KVStoreOptions monkey_options;
+  monkey_options.bloomMemoryBudget = 16 << 10;
+  monkey_options.bloomSkipLastLevel = true;
+  pass &= check_store(monkey_options, "monkey", fullMemory);
+
+  if (!pass)std::cout << "Test failed" << std::endl;
+  else std::cout << "Test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,523 @@
+#include "../kvstore.h"
+#include "../compactionfilter.h"
+#include "../ratelimiter.h"
+#include "../utils.h"
+#include <iostream>
+#include <limits>
+#include <list>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// 写入、删除一批数据后逐个核对get与scan的结果，并在重新打开后再核对一次
+bool check_store(const KVStoreOptions &options, const std::string &name, double *writeAmp = nullptr) {
+  bool pass = true;
+  std::map<uint64_t, std::string> expect;
+  int total = 12000;
+  {
+    KVStore store("data/", options);
+    store.reset();
+    for (int i = 0; i < total; i++) {
+      uint64_t key = (i * 7919ull) % (2 * total + 1);
+      std::string value(2000 + (i * 37) % 3000, 'a' + i % 26);
+      store.put(key, value);
+      expect[key] = value;
+    }
+    for (int i = 0; i < total; i += 3) {
+      uint64_t key = (i * 7919ull) % (2 * total + 1);
+      store.del(key);
+      expect.erase(key);
+    }
+    for (auto &item : expect) {
+      if (store.get(item.first) != item.second) {
+        std::cout << "[" << name << "] Error: get(" << item.first << ") mismatch" << std::endl;
+        pass = false;
+        break;
+      }
+    }
+    std::list<std::pair<uint64_t, std::string>> result;
+    store.scan(0, 2 * total, result);
+    if (result != std::list<std::pair<uint64_t, std::string>>(expect.begin(), expect.end())) {
+      std::cout << "[" << name << "] Error: scan mismatch" << std::endl;
+      pass = false;
+    }
+    std::cout << "[" << name << "] " << store.getCompactionPolicy()->name()
+              << " write amplification: " << store.writeAmplification() << std::endl;
+    if (writeAmp)
+      *writeAmp = store.writeAmplification();
+  }
+  {
+    KVStore store("data/", options);
+    for (uint64_t key = 0; key <= 2 * total; key += 7) {
+      std::string want = expect.count(key) ? expect[key] : "";
+      if (store.get(key) != want) {
+        std::cout << "[" << name << "] Error: get(" << key << ") mismatch after reopen" << std::endl;
+        pass = false;
+        break;
+      }
+    }
+  }
+  return pass;
+}
+
+// 顺序写入时各表键范围互不重叠，合并应全部退化为平凡移动，不产生额外写入
+bool check_sequential(const KVStoreOptions &options, const std::string &name) {
+  bool pass = true;
+  int total = 12000;
+  KVStore store("data/", options);
+  store.reset();
+  for (int i = 0; i < total; i++)
+    store.put(i, std::string(3000, 'a' + i % 26));
+  for (int i = 0; i < total; i += 11) {
+    if (store.get(i) != std::string(3000, 'a' + i % 26)) {
+      std::cout << "[" << name << "] Error: get(" << i << ") mismatch" << std::endl;
+      pass = false;
+      break;
+    }
+  }
+  if (store.writeAmplification() != 1) {
+    std::cout << "[" << name << "] Error: sequential write amplification " << store.writeAmplification()
+              << std::endl;
+    pass = false;
+  }
+  return pass;
+}
+
+// 删除一半数据后手动合并整棵树，删除的键不能复活，剩下的键保持不变
+bool check_compact_all(const KVStoreOptions &options, const std::string &name) {
+  bool pass = true;
+  int total = 12000;
+  std::map<uint64_t, std::string> expect;
+  KVStore store("data/", options);
+  store.reset();
+  for (int i = 0; i < total; i++) {
+    store.put(i, std::string(2000 + i % 1000, 'a' + i % 26));
+    expect[i] = std::string(2000 + i % 1000, 'a' + i % 26);
+  }
+  for (int i = 0; i < total; i += 2) {
+    store.del(i);
+    expect.erase(i);
+  }
+  store.compactRange(total / 4, total / 2);
+  store.compactAll();
+  for (int i = 0; i < total; i++) {
+    std::string want = expect.count(i) ? expect[i] : "";
+    if (store.get(i) != want) {
+      std::cout << "[" << name << "] Error: get(" << i << ") mismatch after compactAll" << std::endl;
+      pass = false;
+      break;
+    }
+  }
+  std::list<std::pair<uint64_t, std::string>> result;
+  store.scan(0, total, result);
+  if (result != std::list<std::pair<uint64_t, std::string>>(expect.begin(), expect.end())) {
+    std::cout << "[" << name << "] Error: scan mismatch after compactAll" << std::endl;
+    pass = false;
+  }
+  return pass;
+}
+
+// 丢弃键为3的倍数的条目，把键为5的倍数的条目改写成"filtered"
+class ModuloFilter : public CompactionFilter {
+public:
+  const char *name() const override { return "modulo"; }
+
+  FilterDecision filter(int level, uint64_t key, std::string_view value, std::string *newValue) override {
+    if (key % 3 == 0)
+      return FilterDecision::Remove;
+    if (key % 5 == 0) {
+      *newValue = "filtered";
+      return FilterDecision::ChangeValue;
+    }
+    return FilterDecision::Keep;
+  }
+};
+
+// 合并过滤器：compactAll之后每个键都经过过滤器，重新打开后结果不变
+bool check_filter(const KVStoreOptions &options, const std::string &name) {
+  bool pass = true;
+  int total = 12000;
+  auto expected = [](uint64_t key) -> std::string {
+    if (key % 3 == 0)
+      return "";
+    if (key % 5 == 0)
+      return "filtered";
+    return std::string(2000 + key % 1000, 'a' + key % 26);
+  };
+  for (int round = 0; round < 2 && pass; round++) {
+    KVStore store("data/", options);
+    if (round == 0) {
+      store.reset();
+      for (int i = 0; i < total; i++)
+        store.put(i, std::string(2000 + i % 1000, 'a' + i % 26));
+      store.compactAll();
+    }
+    for (int i = 0; i < total; i++) {
+      if (store.get(i) != expected(i)) {
+        std::cout << "[" << name << "] Error: get(" << i << ") mismatch in round " << round << std::endl;
+        pass = false;
+        break;
+      }
+    }
+    // 关闭时批量同步了被丢弃的键：它们的嵌入向量是删除标记，其余键的向量不变
+    for (int i = 0; round == 1 && i < total; i += 11) {
+      std::vector<float> vec = store.search_embedding(i);
+      bool deleted = !vec.empty() && vec[0] == std::numeric_limits<float>::max();
+      if (vec.empty() || deleted != (i % 3 == 0)) {
+        std::cout << "[" << name << "] Error: embedding of key " << i << (deleted ? " deleted" : " kept") << std::endl;
+        pass = false;
+        break;
+      }
+    }
+  }
+  return pass;
+}
+
+std::vector<sstablehead> load_level(int level) {
+  std::string path = "./data/level-" + std::to_string(level);
+  std::vector<std::string> files;
+  std::vector<sstablehead> heads;
+  if (!utils::dirExists(path))
+    return heads;
+  utils::scanDir(path, files);
+  for (auto &file : files) {
+    heads.emplace_back();
+    heads.back().loadFileHead((path + "/" + file).c_str());
+  }
+  return heads;
+}
+
+// 分级合并的最底层没有下一层，段数和空间放大要靠整层原地合并来限制；
+// 小表让一次合并写出多个表，它们只算一个段
+bool check_tiered_bottom() {
+  bool pass = true;
+  int total = 12000;
+  KVStoreOptions options;
+  options.compactionStyle = CompactionStyle::Tiered;
+  options.tieredRunsPerLevel = 2;
+  options.levelCount = 3;
+  options.targetFileSize = 256 << 10;
+  KVStore store("data/", options);
+  store.reset();
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < total; i++)
+      store.put((i * 7919ull) % (2 * total + 1), std::string(2000 + (i * 37) % 3000, 'a' + (i + round) % 26));
+  }
+  std::vector<sstablehead> levels[3] = {load_level(0), load_level(1), load_level(2)};
+  TieredCompactionPolicy policy(options.tieredRunsPerLevel);
+  for (int level = 0; level < 3; level++) {
+    double score = policy.score(levels, 3, level);
+    std::cout << "[tiered bottom] level " << level << ": " << levels[level].size() << " tables, "
+              << sortedRuns(levels[level]).size() << " runs, score " << score << std::endl;
+    if (score >= 1) {
+      std::cout << "[tiered bottom] Error: level " << level << " left over its trigger" << std::endl;
+      pass = false;
+    }
+  }
+  if (levels[2].empty()) {
+    std::cout << "[tiered bottom] Error: data never reached the bottom level" << std::endl;
+    pass = false;
+  }
+  for (int i = 0; i < total; i += 7) {
+    if (store.get((i * 7919ull) % (2 * total + 1)) != std::string(2000 + (i * 37) % 3000, 'a' + (i + 1) % 26)) {
+      std::cout << "[tiered bottom] Error: get mismatch" << std::endl;
+      pass = false;
+      break;
+    }
+  }
+  return pass;
+}
+
+// 与level+2层重叠过多时切表：先把一批密集的键压到第2层，再写入一批稀疏的键并合并进第1层，
+// 每个第1层输出表与第2层重叠的字节数不超过maxGrandparentOverlapBytes加一个表
+bool check_grandparent_cut() {
+  bool pass = true;
+  int total = 20000, sparse = 1000, step = total / sparse;
+  std::map<uint64_t, std::string> expect;
+  KVStoreOptions options;
+  options.levelCount = 3;
+  options.targetFileSize = 64 << 10;
+  options.maxBytesForLevelBase = 1; // 第1层一有数据就推到第2层
+  {
+    KVStore store("data/", options);
+    store.reset();
+    for (int i = 0; i < total; i++) {
+      store.put(i, std::string(500, 'a' + i % 26));
+      expect[i] = std::string(500, 'a' + i % 26);
+    }
+    store.compactAll();
+  }
+  // 第1层不再下推，第2层在之后的合并中保持不变
+  options.maxBytesForLevelBase = 1ull << 40;
+  options.maxGrandparentOverlapBytes = 3 * options.targetFileSize;
+  {
+    KVStore store("data/", options);
+    for (int i = 0; i < sparse; i++) {
+      uint64_t key = (i * 7919ull) % sparse * step; // 乱序写入，第0层的表互相重叠，不能平凡移动
+      store.put(key, std::string(500, 'A' + i % 26));
+      expect[key] = std::string(500, 'A' + i % 26);
+    }
+  }
+  std::vector<sstablehead> level1 = load_level(1), level2 = load_level(2);
+  uint64_t level1Bytes = 0, largest = 0, worst = 0;
+  for (auto &head : level2)
+    largest = std::max<uint64_t>(largest, head.getBytes());
+  for (auto &head : level1) {
+    level1Bytes += head.getBytes();
+    uint64_t overlap = 0;
+    for (auto &grandparent : level2) {
+      if (!(head.getMaxV() < grandparent.getMinV() || head.getMinV() > grandparent.getMaxV()))
+        overlap += grandparent.getBytes();
+    }
+    worst = std::max(worst, overlap);
+  }
+  std::cout << "[grandparent-cut] level-1 tables: " << level1.size() << ", level-2 tables: " << level2.size()
+            << ", worst overlap: " << worst << std::endl;
+  if (worst > options.maxGrandparentOverlapBytes + largest) {
+    std::cout << "[grandparent-cut] Error: level-1 table overlaps " << worst << " bytes of level 2" << std::endl;
+    pass = false;
+  }
+  // 只按大小切表时第1层的表数约为 字节数 / targetFileSize，重叠限制应切出明显更多的表
+  if (level1.size() <= level1Bytes / options.targetFileSize + 1) {
+    std::cout << "[grandparent-cut] Error: overlap limit never cut a table" << std::endl;
+    pass = false;
+  }
+  {
+    KVStore store("data/", options);
+    for (int i = 0; i < total; i++) {
+      if (store.get(i) != expect[i]) {
+        std::cout << "[grandparent-cut] Error: get(" << i << ") mismatch" << std::endl;
+        pass = false;
+        break;
+      }
+    }
+    std::list<std::pair<uint64_t, std::string>> result;
+    store.scan(0, total, result);
+    if (result != std::list<std::pair<uint64_t, std::string>>(expect.begin(), expect.end())) {
+      std::cout << "[grandparent-cut] Error: scan mismatch" << std::endl;
+      pass = false;
+    }
+  }
+  return pass;
+}
+
+// 第一次被调用时抛出异常，模拟合并中途的读写错误
+class ThrowOnceFilter : public CompactionFilter {
+public:
+  bool thrown = false;
+
+  const char *name() const override { return "throw-once"; }
+
+  FilterDecision filter(int level, uint64_t key, std::string_view value, std::string *newValue) override {
+    if (!thrown) {
+      thrown = true;
+      throw std::runtime_error("injected compaction error");
+    }
+    return FilterDecision::Keep;
+  }
+};
+
+// 手动合并抛出异常后合并调度必须释放：再次compactRange不能永远等待，数据不受影响
+bool check_compact_range_error() {
+  bool pass = true;
+  int total = 6000;
+  KVStoreOptions options;
+  options.compactionFilter = std::make_shared<ThrowOnceFilter>();
+  KVStore store("data/", options);
+  store.reset();
+  for (int i = 0; i < total; i++)
+    store.put(i, std::string(2000 + i % 1000, 'a' + i % 26));
+  bool thrown = false;
+  try {
+    store.compactAll();
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  if (!thrown) {
+    std::cout << "[compactRange error] Error: injected error not raised" << std::endl;
+    pass = false;
+  }
+  store.compactAll();
+  for (int i = 0; i < total; i++) {
+    if (store.get(i) != std::string(2000 + i % 1000, 'a' + i % 26)) {
+      std::cout << "[compactRange error] Error: get(" << i << ") mismatch" << std::endl;
+      pass = false;
+      break;
+    }
+  }
+  return pass;
+}
+
+sstablehead range_table(uint64_t minV, uint64_t maxV) {
+  sstablehead head;
+  head.setMinV(minV);
+  head.setMaxV(maxV);
+  head.setCnt(100);
+  head.setBytes(64 << 10);
+  return head;
+}
+
+// 轮转选表：游标在合并安装后才前移，只选表不安装（合并失败）时下次重选同样的表；
+// 游标落盘后新的策略对象接着选；游标之后的表不足一个窗口时回到本层开头，不重选末尾的窗口
+bool check_round_robin_wrap() {
+  bool pass = true;
+  std::string cursorFile = "./data/compaction_cursor_test";
+  KVStoreOptions options;
+  options.compactionPick = CompactionPickMode::RoundRobin;
+  std::vector<sstablehead> levels[3];
+  for (uint64_t i = 0; i < 10; i++)
+    levels[1].push_back(range_table(10 * i, 10 * i + 5));
+  auto firstInput = [&](LeveledCompactionPolicy &policy, bool install) {
+    CompactionJob job;
+    if (!policy.pick(levels, 3, 1, job) || job.inputs.size() != 4)
+      return std::numeric_limits<uint64_t>::max();
+    if (install)
+      policy.installed(job);
+    return levels[1][job.inputs[0]].getMinV();
+  };
+  {
+    LeveledCompactionPolicy policy(options, cursorFile);
+    policy.reset();
+    if (firstInput(policy, false) != 0) {
+      std::cout << "[round-robin wrap] Error: first pick does not start at the beginning" << std::endl;
+      pass = false;
+    }
+    if (firstInput(policy, true) != 0) {
+      std::cout << "[round-robin wrap] Error: pick without install advanced the cursor" << std::endl;
+      pass = false;
+    }
+  }
+  {
+    LeveledCompactionPolicy policy(options, cursorFile); // 重新加载落盘的游标
+    if (firstInput(policy, true) != 40) {
+      std::cout << "[round-robin wrap] Error: cursor not restored" << std::endl;
+      pass = false;
+    }
+    // 刚选中的4个表已合并到下一层，游标之后只剩2个表
+    levels[1].erase(levels[1].begin() + 4, levels[1].begin() + 8);
+    if (firstInput(policy, true) != 0) {
+      std::cout << "[round-robin wrap] Error: cursor past the end did not wrap" << std::endl;
+      pass = false;
+    }
+    policy.reset();
+  }
+  return pass;
+}
+
+// 第0层分区：每次flush切成互不重叠的多个表，第0层按重叠深度触发合并，读写结果与不分区时一致
+bool check_partitioned(const KVStoreOptions &options, const std::string &name) {
+  bool pass = check_store(options, name);
+  int total = 12000;
+  KVStore store("data/", options);
+  store.reset();
+  for (int i = 0; i < total; i++)
+    store.put((i * 7919ull) % (2 * total + 1), std::string(2000 + (i * 37) % 3000, 'a' + i % 26));
+  std::vector<std::string> files;
+  std::vector<sstablehead> heads;
+  utils::scanDir("./data/level-0", files);
+  for (auto &file : files) {
+    heads.emplace_back();
+    heads.back().loadFileHead(("./data/level-0/" + file).c_str());
+  }
+  int depth = overlapDepth(heads);
+  std::cout << "[" << name << "] level-0 files: " << heads.size() << ", overlap depth: " << depth << std::endl;
+  if (depth >= options.level0CompactionTrigger || (int)heads.size() <= depth) {
+    std::cout << "[" << name << "] Error: level-0 not partitioned" << std::endl;
+    pass = false;
+  }
+  for (int i = 0; i < total; i += 13) {
+    uint64_t key = (i * 7919ull) % (2 * total + 1);
+    if (store.get(key) != std::string(2000 + (i * 37) % 3000, 'a' + i % 26)) {
+      std::cout << "[" << name << "] Error: get(" << key << ") mismatch" << std::endl;
+      pass = false;
+      break;
+    }
+  }
+  return pass;
+}
+
+int main() {
+  bool pass = true;
+
+  KVStoreOptions sync_options;
+  double leveledWriteAmp = 0;
+  pass &= check_store(sync_options, "sync", &leveledWriteAmp);
+
+  // 后台合并，并把反压阈值调低，让写入路径真正经历减速和停写
+  KVStoreOptions background_options;
+  background_options.backgroundCompaction = true;
+  background_options.level0SlowdownTrigger = 4;
+  background_options.level0StopTrigger = 6;
+  pass &= check_store(background_options, "background");
+
+  // 子合并：每次合并按输入表边界切成多个切片并行归并
+  KVStoreOptions subcompaction_options;
+  subcompaction_options.maxSubcompactions = 4;
+  pass &= check_store(subcompaction_options, "subcompaction");
+
+  // 第0层分区：flush按第1层的边界切成至多4个表，各分区分别下推、并行归并
+  KVStoreOptions partitioned_options;
+  partitioned_options.level0Partitions = 4;
+  pass &= check_partitioned(partitioned_options, "level0-partitions");
+  partitioned_options.backgroundCompaction = true;
+  pass &= check_store(partitioned_options, "level0-partitions background");
+  pass &= check_compact_all(partitioned_options, "level0-partitions compactAll");
+
+  pass &= check_compact_range_error();
+  pass &= check_grandparent_cut();
+
+  // 分级合并：写放大应明显低于分层合并
+  KVStoreOptions tiered_options;
+  tiered_options.compactionStyle = CompactionStyle::Tiered;
+  double tieredWriteAmp = 0;
+  pass &= check_store(tiered_options, "tiered", &tieredWriteAmp);
+  if (tieredWriteAmp >= leveledWriteAmp) {
+    std::cout << "[tiered] Error: write amplification " << tieredWriteAmp << " not below leveled "
+              << leveledWriteAmp << std::endl;
+    pass = false;
+  }
+  pass &= check_tiered_bottom();
+
+  // 轮转选表：游标落盘在数据目录下的compaction_cursor中，重新打开后继续轮转
+  KVStoreOptions round_robin_options;
+  round_robin_options.compactionPick = CompactionPickMode::RoundRobin;
+  pass &= check_store(round_robin_options, "round-robin");
+  pass &= check_round_robin_wrap();
+
+  // 限速：flush走高优先级、合并走低优先级，并按get的读盘延迟自动调节速率
+  KVStoreOptions limited_options;
+  limited_options.rateLimiter = std::make_shared<RateLimiter>(64 << 20);
+  limited_options.rateLimiter->enableAutoTune(2000, 16 << 20, 256 << 20);
+  pass &= check_store(limited_options, "rate-limited");
+  if (!limited_options.rateLimiter->getTotalBytesThrough(IOPriority::High) ||
+      !limited_options.rateLimiter->getTotalBytesThrough(IOPriority::Low)) {
+    std::cout << "[rate-limited] Error: flush or compaction bypassed the rate limiter" << std::endl;
+    pass = false;
+  }
+
+  // 按字节数定目标：小表、大扇出、限制层数，并由最底层大小反推上层目标
+  KVStoreOptions dynamic_options;
+  dynamic_options.targetFileSize = 512 << 10;
+  dynamic_options.maxBytesForLevelBase = 4 << 20;
+  dynamic_options.levelSizeRatio = 4;
+  dynamic_options.levelCount = 5;
+  dynamic_options.dynamicLevelBytes = true;
+  pass &= check_store(dynamic_options, "dynamic-level-bytes");
+
+  // 手动合并
+  pass &= check_compact_all(sync_options, "compact-all");
+  pass &= check_compact_all(background_options, "compact-all-background");
+
+  // 合并过滤器
+  KVStoreOptions filter_options;
+  filter_options.compactionFilter = std::make_shared<ModuloFilter>();
+  pass &= check_filter(filter_options, "compaction-filter");
+
+  // 平凡移动
+  pass &= check_sequential(sync_options, "trivial-move");
+
+  if (!pass)std::cout << "Test failed" << std::endl;
+  else std::cout << "Test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,166 @@
+#include "../kvstore.h"
+#include "../sstable.h"
+#include "../sstablestream.h"
+#include "../utils.h"
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+std::string read_file(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// 流式写出的文件与先复制成sstable再putFile的逐字节相同，缓冲区边界落在值中间也一样
+bool check_same_file() {
+  bool pass = true;
+  skiplist mem(0.5);
+  for (int i = 0; i < 3000; i++) {
+    uint64_t key = (i * 7919ull) % 6007;
+    mem.insert(key, i % 9 == 0 ? DEL : std::string(1 + (i * 37) % 1500, 'a' + i % 26));
+  }
+  utils::mkdir("./data/flush_test");
+  std::string expectPath = "./data/flush_test/expect.sst", gotPath = "./data/flush_test/got.sst";
+  sstable ss(&mem);
+  ss.putFile(expectPath.data());
+  std::string expect = read_file(expectPath);
+  for (size_t bufSize : {4096, 1 << 20}) {
+    memtablewriter writer(&mem, gotPath, ss.getTime(), BloomHashKind::Murmur3, bufSize);
+    sstablehead head = writer.finish();
+    if (read_file(gotPath) != expect) {
+      std::cout << "Error: file differs with buffer " << bufSize << std::endl;
+      pass = false;
+    }
+    if (head.getCnt() != ss.getCnt() || head.getMinV() != ss.getMinV() || head.getMaxV() != ss.getMaxV() ||
+        head.getDelCnt() != ss.getDelCnt() || head.getBytes() != expect.size()) {
+      std::cout << "Error: head differs with buffer " << bufSize << std::endl;
+      pass = false;
+    }
+  }
+  utils::rmfile(expectPath.data());
+  utils::rmfile(gotPath.data());
+  utils::rmdir("./data/flush_test");
+  return pass;
+}
+
+// 合并输出的写缓冲区远小于表时数据经暂存文件分块写出，结果与一次写出的逐字节相同，暂存文件不留下
+bool check_writer_spill() {
+  bool pass = true;
+  utils::mkdir("./data/flush_test");
+  std::string paths[2] = {"./data/flush_test/small.sst", "./data/flush_test/large.sst"};
+  size_t bufSizes[2]   = {4096, 16 << 20};
+  sstablehead heads[2];
+  for (int w = 0; w < 2; w++) {
+    sstablewriter writer(paths[w], 7, nullptr, bufSizes[w]);
+    for (int i = 0; i < 2000; i++)
+      writer.add(i * 3, i % 9 == 0 ? DEL : std::string(1 + (i * 37) % 1500, 'a' + i % 26));
+    heads[w] = writer.finish();
+  }
+  if (read_file(paths[0]) != read_file(paths[1]) || heads[0].getBytes() != read_file(paths[0]).size()) {
+    std::cout << "Error: spilled table differs" << std::endl;
+    pass = false;
+  }
+  if (FILE *file = fopen((paths[0] + sstablewriter::SPILL_SUFFIX).c_str(), "rb")) {
+    fclose(file);
+    std::cout << "Error: spill file left behind" << std::endl;
+    pass = false;
+  }
+  for (auto &path : paths)
+    utils::rmfile(path.data());
+  utils::rmdir("./data/flush_test");
+  return pass;
+}
+
+#ifndef _WIN32
+// 短写（这里用文件大小上限模拟写满磁盘）时finish抛出异常并删除残缺的文件，不能返回表头
+bool check_short_write() {
+  bool pass = true;
+  skiplist mem(0.5);
+  for (int i = 0; i < 1000; i++)
+    mem.insert(i, std::string(1000, 'a' + i % 26));
+  utils::mkdir("./data/flush_test");
+  std::string path = "./data/flush_test/short.sst";
+  struct rlimit old;
+  getrlimit(RLIMIT_FSIZE, &old);
+  struct rlimit limit = old;
+  limit.rlim_cur      = 64 << 10;
+  signal(SIGXFSZ, SIG_IGN); // 超过上限时write返回EFBIG而不是终止进程
+  setrlimit(RLIMIT_FSIZE, &limit);
+  bool thrown = false;
+  try {
+    memtablewriter writer(&mem, path, 1, BloomHashKind::Murmur3, 4096);
+    writer.finish();
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  setrlimit(RLIMIT_FSIZE, &old);
+  signal(SIGXFSZ, SIG_DFL);
+  if (!thrown) {
+    std::cout << "Error: short write not reported" << std::endl;
+    pass = false;
+  }
+  if (FILE *file = fopen(path.c_str(), "rb")) {
+    fclose(file);
+    std::cout << "Error: partial table left behind" << std::endl;
+    pass = false;
+  }
+  utils::rmfile(path.data());
+  utils::rmdir("./data/flush_test");
+  return pass;
+}
+#endif
+
+bool check_all(KVStore &store, std::map<uint64_t, std::string> &expect, int total, const std::string &stage) {
+  for (uint64_t key = 0; key <= 2 * total; key++) {
+    std::string want = expect.count(key) ? expect[key] : "";
+    if (store.get(key) != want) {
+      std::cout << "Error: get(" << key << ") mismatch " << stage << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  bool pass = check_same_file();
+  pass &= check_writer_spill();
+#ifndef _WIN32
+  pass &= check_short_write();
+#endif
+
+  std::map<uint64_t, std::string> expect;
+  int total = 10000;
+  {
+    KVStore store("data/");
+    store.reset();
+    for (int i = 0; i < total; i++) {
+      uint64_t key = (i * 7919ull) % (2 * total + 1);
+      std::string value(500 + (i * 37) % 1500, 'a' + i % 26);
+      store.put(key, value);
+      expect[key] = value;
+    }
+    for (int i = 0; i < total; i += 5) {
+      uint64_t key = (i * 7919ull) % (2 * total + 1);
+      store.del(key);
+      expect.erase(key);
+    }
+    pass &= check_all(store, expect, total, "after writes");
+  }
+  {
+    KVStore store("data/");
+    pass &= check_all(store, expect, total, "after reopen");
+    store.reset();
+  }
+
+  if (!pass)std::cout << "Test failed" << std::endl;
+  else std::cout << "Test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,122 @@
+#include "../hashindex.h"
+#include "../kvstore.h"
+#include "../metacache.h"
+#include "../utils.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// 槽满后插入新键失败并标记不完整，已有的键仍可覆盖、查找和删除
+bool check_slots() {
+  bool pass = true;
+  HashIndex index(10 * 8); // 10个槽，装载上限9个
+  std::vector<uint64_t> keys; // 表1的第pos个键
+  for (uint64_t i = 0; i < 10; i++)
+    keys.push_back(i * 1000003);
+  auto matcher = [&](uint64_t key) {
+    return [&, key](uint32_t id, uint32_t pos) { return id == 1 && keys[pos] == key; };
+  };
+  uint32_t id = index.addTable(42);
+  for (uint32_t i = 0; i < 9; i++) {
+    if (!index.put(keys[i], id, i, matcher(keys[i]))) {
+      std::cout << "[slots] Error: put " << i << " failed" << std::endl;
+      pass = false;
+    }
+  }
+  if (index.put(keys[9], id, 9, matcher(keys[9])) || index.isComplete()) {
+    std::cout << "[slots] Error: put beyond load limit succeeded" << std::endl;
+    pass = false;
+  }
+  for (uint32_t i = 0; i < 9; i++) {
+    int64_t slot = index.find(keys[i], matcher(keys[i]));
+    if (slot < 0 || index.posOf(slot) != i || index.fileOf(slot) != id) {
+      std::cout << "[slots] Error: find " << i << " wrong" << std::endl;
+      pass = false;
+    }
+  }
+  if (index.find(keys[9], matcher(keys[9])) >= 0) {
+    std::cout << "[slots] Error: rejected key found" << std::endl;
+    pass = false;
+  }
+  // 覆盖已有的键不需要新槽
+  if (!index.put(keys[3], id, 3, matcher(keys[3]))) {
+    std::cout << "[slots] Error: overwrite failed when full" << std::endl;
+    pass = false;
+  }
+  index.erase(index.find(keys[0], matcher(keys[0])));
+  if (index.find(keys[0], matcher(keys[0])) >= 0 || index.find(keys[1], matcher(keys[1])) < 0 ||
+      index.size() != 8) {
+    std::cout << "[slots] Error: erase wrong" << std::endl;
+    pass = false;
+  }
+  return pass;
+}
+
+bool check_all(KVStore &store, std::map<uint64_t, std::string> &expect, int total, const std::string &stage) {
+  for (uint64_t key = 0; key <= 2 * total; key++) {
+    std::string want = expect.count(key) ? expect[key] : "";
+    if (store.get(key) != want) {
+      std::cout << "Error: get(" << key << ") mismatch " << stage << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// 写入、覆盖、删除、合并和重新打开之后，经哈希索引的点查与逐层查找结果一致
+bool check_store(KVStoreOptions options, const std::string &name) {
+  bool pass = true;
+  std::map<uint64_t, std::string> expect;
+  int total = 12000;
+  {
+    KVStore store("data/", options);
+    store.reset();
+    for (int round = 0; round < 2; round++) {
+      for (int i = 0; i < total; i++) {
+        uint64_t key = (i * 7919ull) % (2 * total + 1);
+        if ((i + round) % 3 == 0 && round)
+          continue;
+        std::string value(400 + (i * 37 + round) % 800, 'a' + (i + round) % 26);
+        store.put(key, value);
+        expect[key] = value;
+      }
+    }
+    for (int i = 0; i < total; i += 5) {
+      uint64_t key = (i * 7919ull) % (2 * total + 1);
+      store.del(key);
+      expect.erase(key);
+    }
+    pass &= check_all(store, expect, total, name + " after writes");
+  }
+  {
+    KVStore store("data/", options);
+    pass &= check_all(store, expect, total, name + " after reopen");
+    store.compactAll();
+    pass &= check_all(store, expect, total, name + " after compactAll");
+    store.reset();
+    expect.clear();
+    pass &= check_all(store, expect, total, name + " after reset");
+  }
+  return pass;
+}
+
+int main() {
+  bool pass = check_slots();
+
+  KVStoreOptions options;
+  options.hashIndexBytes = 1 << 20; // 装得下全部键
+  pass &= check_store(options, "[full]");
+  options.hashIndexBytes = 64 << 10; // 只装得下一部分，其余退回逐层查找
+  pass &= check_store(options, "[bounded]");
+  options.hashIndexBytes = 1 << 20;
+  options.metadataCache  = std::make_shared<MetaCache>(64 << 10);
+  pass &= check_store(options, "[partitioned]");
+  options.metadataCache = nullptr;
+  options.backgroundCompaction = true;
+  pass &= check_store(options, "[background]");
+
+  if (!pass)std::cout << "Test failed" << std::endl;
+  else std::cout << "Test passed" << std::endl;
+  return 0;
+}
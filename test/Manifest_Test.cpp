@@ -0,0 +1,170 @@
+#include "../kvstore.h"
+#include "../sstablestream.h"
+#include "../utils.h"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <list>
+#include <string>
+
+std::string value_of(int key, int round) {
+  return std::to_string(round) + std::string(2000 + key % 1000, 'a' + key % 26);
+}
+
+bool check_all(KVStore &store, int total, int round, const std::string &stage) {
+  for (int i = 0; i < total; i++) {
+    std::string want = (i % 7 == 0) ? "" : value_of(i, round);
+    if (store.get(i) != want) {
+      std::cout << "Error: get(" << i << ") mismatch " << stage << std::endl;
+      return false;
+    }
+  }
+  std::list<std::pair<uint64_t, std::string>> result;
+  store.scan(0, total, result);
+  if ((int)result.size() != total - (total + 6) / 7) {
+    std::cout << "Error: scan returned " << result.size() << " entries " << stage << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// 重新打开时由MANIFEST恢复各层的表，不扫描读取文件头；时间戳接着上次的最大值。
+// 首次写入用options，之后用默认选项打开：每个表的bloom哈希函数跟着表走，不随选项变化
+bool check_reopen(const KVStoreOptions &options, const std::string &name) {
+  std::cout << "[" << name << "]" << std::endl;
+  bool pass = true;
+  int total = 20000;
+  {
+    KVStore store("./data", options);
+    store.reset();
+    for (int i = 0; i < total; i++)
+      store.put(i, value_of(i, 0));
+    for (int i = 0; i < total; i += 7)
+      store.del(i);
+  }
+
+  // 伪造一个崩溃残留的合并输出，不在清单中，打开时应被删除
+  std::string orphan = "./data/level-0/999999999.sst";
+  FILE *file = fopen(orphan.c_str(), "wb");
+  fclose(file);
+
+  {
+    auto start = std::chrono::steady_clock::now();
+    KVStore store("./data");
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "reopen took " << ms << " ms" << std::endl;
+    if ((file = fopen(orphan.c_str(), "rb"))) {
+      fclose(file);
+      std::cout << "Error: orphan table not removed" << std::endl;
+      pass = false;
+    }
+    pass &= check_all(store, total, 0, "after reopen");
+
+    // 时间戳从清单恢复，重新打开后写入的新版本必须遮住旧版本
+    for (int i = 0; i < total; i++) {
+      if (i % 7)
+        store.put(i, value_of(i, 1));
+    }
+    pass &= check_all(store, total, 1, "after overwrite");
+  }
+
+  // 没有清单时并行读取每个文件头，并重新写出清单
+  utils::rmfile("./data/MANIFEST");
+  {
+    KVStore store("./data");
+    pass &= check_all(store, total, 1, "after reopen without manifest");
+  }
+
+  // 快照记录写了一半：不能据此把所有表当作清单之外的文件删掉，应退回读取文件头
+  std::filesystem::resize_file("./data/MANIFEST", 6);
+  {
+    KVStore store("./data");
+    pass &= check_all(store, total, 1, "after reopen with torn snapshot");
+  }
+
+  {
+    KVStore store("./data");
+    pass &= check_all(store, total, 1, "after second reopen");
+    store.compactAll();
+    pass &= check_all(store, total, 1, "after compactAll");
+    store.reset();
+  }
+
+  {
+    KVStore store("./data");
+    if (store.get(1) != "") {
+      std::cout << "Error: data survived reset" << std::endl;
+      pass = false;
+    }
+  }
+  return pass;
+}
+
+// 文件头记录了bloom的哈希函数，没有清单时按它恢复；旧文件（没有记录）退回抽查键判断；文件不存在时不崩溃
+bool check_file_head() {
+  std::cout << "[file head]" << std::endl;
+  bool pass = true;
+  std::string path = "./data/head_test.sst";
+  for (BloomHashKind kind : {BloomHashKind::Murmur3, BloomHashKind::Mix64}) {
+    {
+      sstablewriter writer(path, 1);
+      writer.setBloomHash(kind);
+      for (int i = 0; i < 1000; i++)
+        writer.add(i * 3, value_of(i, 0));
+      writer.finish();
+    }
+    sstablehead head;
+    head.loadFileHead(path.c_str());
+    if (head.getCnt() != 1000 || head.getBloomHash() != kind) {
+      std::cout << "Error: file head cnt " << head.getCnt() << " or hash kind not recorded" << std::endl;
+      pass = false;
+    }
+
+    // 抹掉记录，模拟旧格式的文件
+    uint64_t cnt = 1000;
+    FILE *file = fopen(path.c_str(), "rb+");
+    fseek(file, 8, SEEK_SET);
+    fwrite(&cnt, 8, 1, file);
+    fclose(file);
+    sstablehead legacy;
+    legacy.loadFileHead(path.c_str());
+    if (legacy.getCnt() != 1000 || legacy.getBloomHash() != kind) {
+      std::cout << "Error: legacy file head not probed correctly" << std::endl;
+      pass = false;
+    }
+    for (int i = 0; i < 1000; i++) {
+      if (legacy.search(i * 3) != i) {
+        std::cout << "Error: legacy table lost key " << i * 3 << std::endl;
+        pass = false;
+        break;
+      }
+    }
+  }
+  utils::rmfile(path.c_str());
+
+  sstablehead missing;
+  missing.loadFileHead("./data/no_such_table.sst");
+  if (missing.getCnt() != 0) {
+    std::cout << "Error: missing table has entries" << std::endl;
+    pass = false;
+  }
+  return pass;
+}
+
+int main() {
+  bool pass = true;
+
+  KVStoreOptions murmur_options;
+  pass &= check_reopen(murmur_options, "murmur3");
+
+  KVStoreOptions mix64_options;
+  mix64_options.bloomHash = BloomHashKind::Mix64;
+  pass &= check_reopen(mix64_options, "mix64");
+
+  pass &= check_file_head();
+
+  if (!pass)std::cout << "Test failed" << std::endl;
+  else std::cout << "Test passed" << std::endl;
+  return 0;
+}
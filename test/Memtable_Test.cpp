@@ -0,0 +1,167 @@
+#include "../hashvector.h"
+#include "../kvstore.h"
+#include "../radixtree.h"
+#include "../skiplist.h"
+#include "../utils.h"
+#include <iostream>
+#include <list>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+// 与std::map对比插入、覆盖、点查、范围查询和有序遍历；键覆盖公共前缀很长和跨越所有字节的情况
+bool check_memtable(memtable &mem, const std::string &name) {
+  bool pass = true;
+  std::map<uint64_t, std::string> expect;
+  std::mt19937_64 rng(7);
+  std::vector<uint64_t> keys;
+  for (uint64_t i = 0; i < 3000; i++) {
+    keys.push_back(rng());               // 随机的64位键
+    keys.push_back(i);                    // 高7个字节全为0
+    keys.push_back(0xabcdef0000000000ull | (i * 131)); // 长公共前缀
+  }
+  keys.push_back(0);
+  keys.push_back(UINT64_MAX - 1); // 跳表以UINT64_MAX作尾哨兵
+  for (size_t i = 0; i < keys.size(); i++) {
+    std::string value = std::to_string(i) + std::string(i % 50, 'x');
+    mem.insert(keys[i], value);
+    expect[keys[i]] = value;
+    if (i % 3 == 0) { // 覆盖已有的键
+      uint64_t key = keys[rng() % (i + 1)];
+      mem.insert(key, "v" + std::to_string(i));
+      expect[key] = "v" + std::to_string(i);
+    }
+  }
+  uint32_t bytes = 0;
+  for (auto &[key, value] : expect)
+    bytes += 12 + value.size();
+  if (mem.getBytes() != bytes) {
+    std::cout << name << " Error: bytes " << mem.getBytes() << " != " << bytes << std::endl;
+    pass = false;
+  }
+  for (auto &[key, value] : expect) {
+    if (mem.search(key) != value || mem.search(key + 1) != (expect.count(key + 1) ? expect[key + 1] : "")) {
+      std::cout << name << " Error: search(" << key << ") mismatch" << std::endl;
+      pass = false;
+      break;
+    }
+  }
+  std::vector<std::pair<uint64_t, std::string>> all;
+  mem.forEach([&](uint64_t key, const std::string &value) { all.emplace_back(key, value); });
+  if (all != std::vector<std::pair<uint64_t, std::string>>(expect.begin(), expect.end())) {
+    std::cout << name << " Error: forEach not in order" << std::endl;
+    pass = false;
+  }
+  for (int i = 0; i < 200; i++) {
+    uint64_t a = rng() >> (rng() % 64), b = rng() >> (rng() % 64);
+    if (i % 4 == 0)
+      a = b = keys[rng() % keys.size()];
+    if (a > b)
+      std::swap(a, b);
+    std::vector<std::pair<uint64_t, std::string>> got;
+    mem.scan(a, b, got);
+    std::vector<std::pair<uint64_t, std::string>> want(expect.lower_bound(a), expect.upper_bound(b));
+    if (got != want) {
+      std::cout << name << " Error: scan(" << a << ", " << b << ") mismatch" << std::endl;
+      pass = false;
+      break;
+    }
+  }
+  mem.reset();
+  if (!mem.empty() || mem.getBytes() || mem.search(keys[0]) != "") {
+    std::cout << name << " Error: reset left entries" << std::endl;
+    pass = false;
+  }
+  return pass;
+}
+
+// 条目数超过PARALLEL_SORT_MIN时hashvector分段并行排序，检查归并后的顺序和插入新键后重新排序
+bool check_parallel_sort() {
+  bool pass = true;
+  hashvector vec;
+  std::map<uint64_t, std::string> expect;
+  std::mt19937_64 rng(11);
+  for (int round = 0; round < 2; round++) {
+    for (size_t i = 0; i < 3 * hashvector::PARALLEL_SORT_MIN + 17; i++) {
+      uint64_t key = rng() % 1000000000;
+      vec.insert(key, std::to_string(i));
+      expect[key] = std::to_string(i);
+    }
+    std::vector<std::pair<uint64_t, std::string>> all;
+    vec.forEach([&](uint64_t key, const std::string &value) { all.emplace_back(key, value); });
+    if (all != std::vector<std::pair<uint64_t, std::string>>(expect.begin(), expect.end())) {
+      std::cout << "[hashvector parallel] Error: forEach not in order in round " << round << std::endl;
+      pass = false;
+    }
+  }
+  return pass;
+}
+
+bool check_store(MemtableType type, const std::string &name) {
+  bool pass = true;
+  KVStoreOptions options;
+  options.memtableType = type;
+  std::map<uint64_t, std::string> expect;
+  int total = 10000;
+  {
+    KVStore store("data/", options);
+    store.reset();
+    for (int i = 0; i < total; i++) {
+      uint64_t key = (i * 7919ull) % (2 * total + 1);
+      std::string value(300 + (i * 37) % 1200, 'a' + i % 26);
+      store.put(key, value);
+      expect[key] = value;
+    }
+    for (int i = 0; i < total; i += 5) {
+      uint64_t key = (i * 7919ull) % (2 * total + 1);
+      store.del(key);
+      expect.erase(key);
+    }
+    for (uint64_t key = 0; key <= 2 * total; key++) {
+      if (store.get(key) != (expect.count(key) ? expect[key] : "")) {
+        std::cout << name << " Error: get(" << key << ") mismatch" << std::endl;
+        pass = false;
+        break;
+      }
+    }
+    std::list<std::pair<uint64_t, std::string>> result;
+    store.scan(0, 2 * total, result);
+    if (result != std::list<std::pair<uint64_t, std::string>>(expect.begin(), expect.end())) {
+      std::cout << name << " Error: scan mismatch" << std::endl;
+      pass = false;
+    }
+  }
+  {
+    KVStore store("data/", options);
+    for (uint64_t key = 0; key <= 2 * total; key++) {
+      if (store.get(key) != (expect.count(key) ? expect[key] : "")) {
+        std::cout << name << " Error: get(" << key << ") mismatch after reopen" << std::endl;
+        pass = false;
+        break;
+      }
+    }
+    store.reset();
+  }
+  return pass;
+}
+
+int main() {
+  bool pass = true;
+  skiplist list(0.5);
+  radixtree tree;
+  hashvector vec;
+  pass &= check_memtable(list, "[skiplist]");
+  pass &= check_memtable(tree, "[radixtree]");
+  pass &= check_memtable(tree, "[radixtree reused]");
+  pass &= check_memtable(vec, "[hashvector]");
+  pass &= check_memtable(vec, "[hashvector reused]");
+  pass &= check_parallel_sort();
+  pass &= check_store(MemtableType::SkipList, "[store skiplist]");
+  pass &= check_store(MemtableType::RadixTree, "[store radixtree]");
+  pass &= check_store(MemtableType::HashVector, "[store hashvector]");
+
+  if (!pass)std::cout << "Test failed" << std::endl;
+  else std::cout << "Test passed" << std::endl;
+  return 0;
+}
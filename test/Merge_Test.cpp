@@ -0,0 +1,98 @@
+#include "../kvstore.h"
+#include "../mergeoperator.h"
+#include <iostream>
+#include <list>
+#include <map>
+#include <string>
+
+// 计数器：合并、覆盖写和删除交错，跨越多次落盘和合并后与std::map逐个核对
+bool check_counter(const KVStoreOptions &options, const std::string &name) {
+  bool pass = true;
+  int keys = 500;
+  std::map<uint64_t, uint64_t> expect;
+  auto check_all = [&](KVStore &store, const std::string &stage) {
+    for (int k = 0; k < keys; k++) {
+      std::string want = expect.count(k) ? std::to_string(expect[k]) : "";
+      if (store.get(k) != want) {
+        std::cout << "[" << name << "] Error: get(" << k << ") mismatch " << stage << std::endl;
+        return false;
+      }
+    }
+    std::list<std::pair<uint64_t, std::string>> result;
+    store.scan(0, keys - 1, result);
+    if (result.size() != expect.size()) {
+      std::cout << "[" << name << "] Error: scan size mismatch " << stage << std::endl;
+      return false;
+    }
+    return true;
+  };
+  {
+    KVStore store("data/", options);
+    store.reset();
+    for (int round = 0; round < 60; round++) {
+      for (int k = 0; k < keys; k++) {
+        if ((k + round) % 97 == 0) {
+          store.put(k, "5");
+          expect[k] = 5;
+        } else if ((k * 7 + round) % 131 == 0) {
+          store.del(k);
+          expect.erase(k);
+        } else {
+          store.merge(k, std::to_string(k % 10 + 1));
+          expect[k] += k % 10 + 1;
+        }
+      }
+      // 填充数据，让操作数分散到多个SSTable和多层中
+      for (int k = 0; k < 200; k++)
+        store.put(100000 + round * 200 + k, std::string(3000, 'x'));
+    }
+    pass &= check_all(store, "before compactAll");
+    store.compactAll();
+    pass &= check_all(store, "after compactAll");
+  }
+  {
+    KVStore store("data/", options);
+    pass &= check_all(store, "after reopen");
+  }
+  return pass;
+}
+
+// 字符串追加：操作数都写在基础值之前时，折叠结果与追加顺序一致
+bool check_append(const KVStoreOptions &options, const std::string &name) {
+  bool pass = true;
+  KVStore store("data/", options);
+  store.reset();
+  std::string expect;
+  for (int i = 0; i < 20; i++) {
+    store.merge(1, std::to_string(i));
+    expect += (i ? "," : "") + std::to_string(i);
+    for (int k = 0; k < 200; k++)
+      store.put(1000 + i * 200 + k, std::string(3000, 'y'));
+  }
+  if (store.get(1) != expect) {
+    std::cout << "[" << name << "] Error: appended value mismatch" << std::endl;
+    pass = false;
+  }
+  return pass;
+}
+
+int main() {
+  bool pass = true;
+
+  KVStoreOptions counter_options;
+  counter_options.mergeOperator = std::make_shared<UInt64AddOperator>();
+  pass &= check_counter(counter_options, "counter");
+
+  KVStoreOptions background_options = counter_options;
+  background_options.backgroundCompaction = true;
+  background_options.maxSubcompactions = 3;
+  pass &= check_counter(background_options, "counter-background");
+
+  KVStoreOptions append_options;
+  append_options.mergeOperator = std::make_shared<StringAppendOperator>();
+  pass &= check_append(append_options, "append");
+
+  if (!pass)std::cout << "Test failed" << std::endl;
+  else std::cout << "Test passed" << std::endl;
+  return 0;
+}
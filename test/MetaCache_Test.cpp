@@ -0,0 +1,153 @@
+#include "../kvstore.h"
+#include "../metacache.h"
+#include "../utils.h"
+#include <iostream>
+#include <list>
+#include <map>
+#include <string>
+
+// 超过容量时淘汰最久未用的条目，lookup会刷新条目的新旧
+bool check_lru() {
+  bool pass = true;
+  MetaCache cache(1000, 1);
+  for (uint32_t block = 0; block < 3; block++)
+    cache.insert(1, block, std::make_shared<int>(block), 300);
+  cache.lookup(1, 0); // 0变为最近使用，下一次插入淘汰1
+  cache.insert(1, 3, std::make_shared<int>(3), 300);
+  if (!cache.lookup(1, 0) || cache.lookup(1, 1) || !cache.lookup(1, 3)) {
+    std::cout << "[lru] Error: wrong entry evicted" << std::endl;
+    pass = false;
+  }
+  if (cache.getUsage() > cache.getCapacity()) {
+    std::cout << "[lru] Error: usage " << cache.getUsage() << " over capacity" << std::endl;
+    pass = false;
+  }
+  cache.erase(1, 0);
+  if (cache.lookup(1, 0)) {
+    std::cout << "[lru] Error: erased entry still present" << std::endl;
+    pass = false;
+  }
+  return pass;
+}
+
+bool check_all(KVStore &store, std::map<uint64_t, std::string> &expect, int total, const std::string &stage) {
+  for (uint64_t key = 0; key <= 2 * total; key++) {
+    std::string want = expect.count(key) ? expect[key] : "";
+    if (store.get(key) != want) {
+      std::cout << "Error: get(" << key << ") mismatch " << stage << std::endl;
+      return false;
+    }
+  }
+  std::list<std::pair<uint64_t, std::string>> result, parallel;
+  store.scan(0, 2 * total, result);
+  store.scan_parallel(0, 2 * total, parallel);
+  std::list<std::pair<uint64_t, std::string>> want(expect.begin(), expect.end());
+  if (result != want || parallel != want) {
+    std::cout << "Error: scan mismatch " << stage << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void write_all(KVStore &store, std::map<uint64_t, std::string> &expect, int total, char base, int shift) {
+  for (int i = 0; i < total; i++) {
+    uint64_t key = (i * 7919ull) % (2 * total + 1);
+    std::string value(800 + (i * 37 + shift) % 800, base + i % 13);
+    store.put(key, value);
+    expect[key] = value;
+  }
+}
+
+// 缓存比单个目录活得长：目录被清空后重新写入，新表的时间戳与缓存中旧表的相同，不能读到旧表的索引；
+// 删除表时它在缓存中的分区随之删除
+bool check_reused_time(int total) {
+  bool pass = true;
+  KVStoreOptions options;
+  options.metadataCache = std::make_shared<MetaCache>(1 << 20);
+  {
+    std::map<uint64_t, std::string> expect;
+    KVStore store("data/", options);
+    store.reset();
+    TIME = 0;
+    write_all(store, expect, total, 'a', 0);
+    pass &= check_all(store, expect, total, "before wipe");
+  }
+  // 绕过reset直接删除文件，缓存中旧表的条目仍在
+  std::vector<std::string> files;
+  for (int level = 0; utils::dirExists("./data/level-" + std::to_string(level)); level++) {
+    std::string path = "./data/level-" + std::to_string(level);
+    files.clear();
+    int size = utils::scanDir(path, files);
+    for (int i = 0; i < size; ++i)
+      utils::rmfile((path + "/" + files[i]).data());
+  }
+  utils::rmfile("./data/MANIFEST");
+  size_t stale = options.metadataCache->getUsage();
+  TIME = 0; // 另一个目录（或另一个进程写下的目录）的时间戳从头开始
+  {
+    std::map<uint64_t, std::string> expect;
+    KVStore store("data/", options);
+    write_all(store, expect, total, 'n', 400); // 值长度不同，偏移也不同
+    pass &= check_all(store, expect, total, "after wipe");
+    store.reset();
+    if (options.metadataCache->getUsage() > stale) {
+      std::cout << "Error: deleted tables still cached, usage " << options.metadataCache->getUsage() << std::endl;
+      pass = false;
+    }
+  }
+  return pass;
+}
+
+// 元数据缓存远小于全部索引和过滤器时，读写结果不变，缓存用量不超过容量
+int main() {
+  bool pass = check_lru();
+  pass &= check_reused_time(6000);
+
+  KVStoreOptions options;
+  options.metadataCache = std::make_shared<MetaCache>(64 << 10);
+  std::map<uint64_t, std::string> expect;
+  int total = 15000;
+  {
+    KVStore store("data/", options);
+    store.reset();
+    for (int i = 0; i < total; i++) {
+      uint64_t key = (i * 7919ull) % (2 * total + 1);
+      std::string value(800 + (i * 37) % 800, 'a' + i % 26);
+      store.put(key, value);
+      expect[key] = value;
+    }
+    for (int i = 0; i < total; i += 5) {
+      uint64_t key = (i * 7919ull) % (2 * total + 1);
+      store.del(key);
+      expect.erase(key);
+    }
+    pass &= check_all(store, expect, total, "after writes");
+    if (store.filterMemory() != 0) {
+      std::cout << "Error: filters still resident" << std::endl;
+      pass = false;
+    }
+  }
+  {
+    KVStore store("data/", options);
+    pass &= check_all(store, expect, total, "after reopen");
+  }
+  utils::rmfile("./data/MANIFEST");
+  {
+    KVStore store("data/", options);
+    pass &= check_all(store, expect, total, "after reopen without manifest");
+    store.compactAll();
+    pass &= check_all(store, expect, total, "after compactAll");
+  }
+
+  MetaCache &cache = *options.metadataCache;
+  std::cout << "cache usage " << cache.getUsage() << "/" << cache.getCapacity() << ", hits " << cache.getHits()
+            << ", misses " << cache.getMisses() << std::endl;
+  if (cache.getUsage() > cache.getCapacity() || !cache.getHits()) {
+    std::cout << "Error: cache usage over capacity or never hit" << std::endl;
+    pass = false;
+  }
+
+  if (!pass)std::cout << "Test failed" << std::endl;
+  else std::cout << "Test passed" << std::endl;
+  return 0;
+}
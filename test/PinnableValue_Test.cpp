@@ -0,0 +1,119 @@
+#include "../kvstore.h"
+#include "../mergeoperator.h"
+#include "../pinnablevalue.h"
+#include "../utils.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+bool check_all(KVStore &store, std::map<uint64_t, std::string> &expect, int total, const std::string &stage,
+               size_t &pinned) {
+  PinnableValue value;
+  for (uint64_t key = 0; key <= 2 * total; key++) {
+    std::string want = expect.count(key) ? expect[key] : "";
+    bool found       = store.get(key, value);
+    if (found != !want.empty() || value.view() != want || store.get(key) != want) {
+      std::cout << "Error: get(" << key << ") mismatch " << stage << std::endl;
+      return false;
+    }
+    pinned += value.isPinned();
+  }
+  return true;
+}
+
+// 钉住的值与get返回的副本一致，表被合并删除后仍然可以访问
+int main() {
+  bool pass = true;
+  KVStoreOptions options;
+  options.mergeOperator = std::make_shared<StringAppendOperator>();
+  std::map<uint64_t, std::string> expect;
+  int total     = 10000;
+  size_t pinned = 0;
+  {
+    KVStore store("data/", options);
+    store.reset();
+    for (int i = 0; i < total; i++) {
+      uint64_t key = (i * 7919ull) % (2 * total + 1);
+      std::string value(500 + (i * 37) % 1500, 'a' + i % 26);
+      if (i % 7 == 0) {
+        store.put(key, value, 3600 * 1000); // 带过期时间的值，视图剥去编码头
+      } else {
+        store.put(key, value);
+      }
+      expect[key] = value;
+    }
+    for (int i = 0; i < total; i += 11) {
+      uint64_t key = (i * 7919ull) % (2 * total + 1);
+      store.merge(key, "m");
+      expect[key] += ",m";
+    }
+    for (int i = 0; i < total; i += 5) {
+      uint64_t key = (i * 7919ull) % (2 * total + 1);
+      store.del(key);
+      expect.erase(key);
+    }
+    pass &= check_all(store, expect, total, "after writes", pinned);
+    if (!pinned) {
+      std::cout << "Error: no value was pinned" << std::endl;
+      pass = false;
+    }
+
+    // 先钉住一批值，再合并删除它们所在的表
+    std::vector<std::pair<uint64_t, PinnableValue>> held;
+    for (auto &[key, want] : expect) {
+      PinnableValue value;
+      if (store.get(key, value) && value.isPinned())
+        held.emplace_back(key, std::move(value));
+      if (held.size() >= 200)
+        break;
+    }
+    store.compactAll();
+    for (auto &[key, value] : held) {
+      if (value.view() != expect[key]) {
+        std::cout << "Error: pinned value of " << key << " changed after compaction" << std::endl;
+        pass = false;
+        break;
+      }
+    }
+    pass &= check_all(store, expect, total, "after compactAll", pinned);
+  }
+  {
+    // 映射缓存只留2个文件：钉住的值在映射被淘汰后仍然有效，读结果不变
+    KVStoreOptions small_options  = options;
+    small_options.maxMappedFiles = 2;
+    KVStore store("data/", small_options);
+    std::vector<std::pair<uint64_t, PinnableValue>> held;
+    for (auto &[key, want] : expect) {
+      PinnableValue value;
+      if (store.get(key, value) && value.isPinned() && key % 37 == 0)
+        held.emplace_back(key, std::move(value));
+    }
+    pass &= check_all(store, expect, total, "after reopen", pinned);
+    for (auto &[key, value] : held) {
+      if (value.view() != expect[key]) {
+        std::cout << "Error: pinned value of " << key << " changed after its mapping was evicted" << std::endl;
+        pass = false;
+        break;
+      }
+    }
+    store.reset();
+  }
+  {
+    KVStoreOptions unmapped_options  = options;
+    unmapped_options.maxMappedFiles = 0;
+    KVStore store("data/", unmapped_options);
+    store.put(1, "one");
+    store.compactAll();
+    PinnableValue value;
+    if (!store.get(1, value) || value.view() != "one") {
+      std::cout << "Error: get without mapping cache mismatch" << std::endl;
+      pass = false;
+    }
+    store.reset();
+  }
+
+  if (!pass)std::cout << "Test failed" << std::endl;
+  else std::cout << "Test passed" << std::endl;
+  return 0;
+}
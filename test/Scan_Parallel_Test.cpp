@@ -0,0 +1,55 @@
+#include "../kvstore.h"
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+int main() {
+  KVStore store("data/");
+
+  store.reset();
+
+  bool pass = true;
+
+  // 写入足够多的数据，使其落到多层多个SSTable中
+  int total = 4096;
+  for (int i = 0; i < total; i++) {
+    store.put(i, std::string(1024 + i % 512, 'a' + i % 26));
+  }
+  for (int i = 0; i < total; i += 3) {
+    store.del(i);
+  }
+
+  std::vector<std::pair<uint64_t, uint64_t>> ranges = {{0, total}, {100, 900}, {2048, 2048}, {total - 10, total + 10}};
+  for (auto &range : ranges) {
+    std::list<std::pair<uint64_t, std::string>> expect, got;
+    store.scan(range.first, range.second, expect);
+    store.scan_parallel(range.first, range.second, got);
+    if (expect != got) {
+      std::cout << "Error: scan_parallel(" << range.first << ", " << range.second << ") differs from scan" << std::endl;
+      pass = false;
+    }
+
+    // 流式回调：结果块必须按键严格递增
+    uint64_t last = 0;
+    size_t count = 0;
+    store.scan_parallel(range.first, range.second, [&](std::vector<std::pair<uint64_t, std::string>> &chunk) {
+      for (auto &item : chunk) {
+        if (count && item.first <= last) {
+          std::cout << "Error: chunks are not in order at key " << item.first << std::endl;
+          pass = false;
+        }
+        last = item.first;
+        count++;
+      }
+    });
+    if (count != expect.size()) {
+      std::cout << "Error: callback received " << count << " pairs, expected " << expect.size() << std::endl;
+      pass = false;
+    }
+  }
+
+  if (!pass)std::cout << "Test failed" << std::endl;
+  else std::cout << "Test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,111 @@
+#include "../kvstore.h"
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <string>
+#include <thread>
+#include <vector>
+
+std::string value_of(int key) {
+  return std::string(2000 + key % 1000, 'a' + key % 26);
+}
+
+// 奇数键带过期时间写入：过期前可读，过期后get/scan都看不到，合并后也不会复活
+bool check_ttl(const KVStoreOptions &options, const std::string &name) {
+  bool pass = true;
+  int total = 8000;
+  KVStore store("data/", options);
+  store.reset();
+  for (int i = 0; i < total; i++) {
+    if (i % 2)
+      store.put(i, value_of(i), 500);
+    else
+      store.put(i, value_of(i));
+  }
+  if (store.get(total - 1) != value_of(total - 1)) {
+    std::cout << "[" << name << "] Error: entry expired too early" << std::endl;
+    pass = false;
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(600));
+  auto check_all = [&](const std::string &stage) {
+    for (int i = 0; i < total; i++) {
+      std::string want = (i % 2) ? "" : value_of(i);
+      if (store.get(i) != want) {
+        std::cout << "[" << name << "] Error: get(" << i << ") mismatch " << stage << std::endl;
+        return false;
+      }
+    }
+    std::list<std::pair<uint64_t, std::string>> result;
+    store.scan(0, total, result);
+    if ((int)result.size() != total / 2) {
+      std::cout << "[" << name << "] Error: scan returned " << result.size() << " entries " << stage << std::endl;
+      return false;
+    }
+    return true;
+  };
+  pass &= check_all("after expiry");
+
+  // 过期后重新写入的值不受旧过期时间影响
+  store.put(1, "fresh", 60 * 1000);
+  store.compactAll();
+  if (store.get(1) != "fresh") {
+    std::cout << "[" << name << "] Error: rewritten key lost after compaction" << std::endl;
+    pass = false;
+  }
+  store.del(1);
+  pass &= check_all("after compactAll");
+  return pass;
+}
+
+// 合并到最底层丢弃的过期键，关闭时同步到嵌入向量存储：重新打开后它们的向量是删除标记，未过期的键不受影响
+bool check_expired_embeddings() {
+  bool pass = true;
+  int total = 3000;
+  {
+    KVStore store("data/");
+    store.reset();
+    for (int i = 0; i < total; i++) {
+      if (i % 2)
+        store.put(i, value_of(i), 300);
+      else
+        store.put(i, value_of(i));
+    }
+    store.compactAll();
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    // 重写偶数键，让过期的表真正经过归并（而不是平凡移动）到最底层
+    for (int i = 0; i < total; i += 2)
+      store.put(i, value_of(i));
+    store.compactAll();
+  }
+  KVStore store("data/");
+  for (int i = 0; i < total; i += 7) {
+    std::vector<float> vec = store.search_embedding(i);
+    bool deleted = !vec.empty() && vec[0] == std::numeric_limits<float>::max();
+    if (vec.empty() || deleted != (i % 2 == 1)) {
+      std::cout << "[embeddings] Error: key " << i << (deleted ? " deleted" : " kept") << std::endl;
+      pass = false;
+      break;
+    }
+  }
+  store.reset();
+  return pass;
+}
+
+int main() {
+  bool pass = true;
+
+  KVStoreOptions sync_options;
+  pass &= check_ttl(sync_options, "sync");
+
+  KVStoreOptions background_options;
+  background_options.backgroundCompaction = true;
+  pass &= check_ttl(background_options, "background");
+
+  pass &= check_expired_embeddings();
+
+  if (!pass)std::cout << "Test failed" << std::endl;
+  else std::cout << "Test passed" << std::endl;
+  return 0;
+}
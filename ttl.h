@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef LSM_KV_TTL_H
+#define LSM_KV_TTL_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief 带过期时间的值的编码：TTL_PREFIX + 8字节过期时刻(unix毫秒) + 原值
+ *
+ * 和DEL一样是值内的保留格式，普通put的值不应以TTL_PREFIX开头
+ */
+inline const std::string TTL_PREFIX = "~TTL~";
+
+inline uint64_t nowMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+inline std::string encodeTTL(std::string_view value, uint64_t expireAt) {
+    std::string res;
+    res.reserve(TTL_PREFIX.size() + 8 + value.size());
+    res.append(TTL_PREFIX);
+    res.append((const char *)&expireAt, 8);
+    res.append(value);
+    return res;
+}
+
+inline bool hasTTL(std::string_view value) {
+    return value.size() >= TTL_PREFIX.size() + 8 && value.compare(0, TTL_PREFIX.size(), TTL_PREFIX) == 0;
+}
+
+inline uint64_t ttlExpireAt(std::string_view value) {
+    uint64_t expireAt;
+    memcpy(&expireAt, value.data() + TTL_PREFIX.size(), 8);
+    return expireAt;
+}
+
+inline std::string_view ttlValue(std::string_view value) {
+    return value.substr(TTL_PREFIX.size() + 8);
+}
+
+inline bool isExpired(std::string_view value, uint64_t now) {
+    return hasTTL(value) && ttlExpireAt(value) <= now;
+}
+
+#endif // LSM_KV_TTL_H
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdio>
 #include <sstream>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -137,4 +138,34 @@ static inline int rmfile(const char *path) {
 #endif
 }
 
+/**
+ * Create a hard link, used to move a sstable to another level without rewriting it
+ * @param from existing file.
+ * @param to new path, in the same file system.
+ * @return 0 if link successfully, -1 otherwise.
+ */
+static inline int lnfile(const char *from, const char *to) {
+#ifdef _WIN32
+    return ::CreateHardLinkA(to, from, NULL) ? 0 : -1;
+#else
+    return ::link(from, to);
+#endif
+}
+
+/**
+ * Flush a file's data to disk, used once at the end of writing a sstable
+ * @param file file opened for writing.
+ * @return 0 if sync successfully, -1 otherwise.
+ */
+static inline int syncfile(FILE *file) {
+    fflush(file);
+#ifdef _WIN32
+    return ::_commit(::_fileno(file));
+#elif defined(__APPLE__)
+    return ::fsync(fileno(file));
+#else
+    return ::fdatasync(fileno(file));
+#endif
+}
+
 } // namespace utils